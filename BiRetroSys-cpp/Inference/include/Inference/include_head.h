@@ -1,10 +1,25 @@
 #pragma once
 #include <filesystem>
 #include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <future>
+#include <condition_variable>
+#include <chrono>
 #include <onnxruntime_cxx_api.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <MolHandler/data_utils.h>
 
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
+
 #ifdef _OPENMP
     #include <omp.h>
     #define _OPPAL false
@@ -1,10 +1,31 @@
 #pragma once
 #include <Inference/include_head.h>
+#include <Inference/mpmc_queue.h>
 
 namespace Inference {
     enum modelClass {uspto50k, usptofull};
 
 //----------------------------------------------------------------------------
+    // beam history kept as one (token, parent row) pair per row and step,
+    // full sequences are only rebuilt when a hypothesis is stored or returned
+    class BeamHistory {
+        public:
+        BeamHistory(const int64_t rows=0, const int64_t bosIds=-1);
+
+        // room for steps more steps, append does not allocate within it
+        void reserve(const int64_t steps);
+        void append(const std::vector<int64_t> &tokens, const std::vector<int64_t> &parents);
+        std::vector<int64_t> trace(int64_t row) const;
+        // same into hyp, which keeps its capacity
+        void trace(int64_t row, std::vector<int64_t> &hyp) const;
+        int64_t length() const;
+
+        private:
+        int64_t rowNum;
+        std::vector<int64_t> tokens;
+        std::vector<int64_t> parents;
+    };
+
     class SearchHypotheses {
         public:
         const int64_t beamSize;
@@ -15,12 +36,16 @@ namespace Inference {
 
         SearchHypotheses(const int64_t beamSize, const float lengthPenalty, const bool doEarlyStop);
 
-        void push(const std::vector<int64_t> &hyp, float sumLogProbs);
+        // sequence storage for hypotheses of up to maxLength tokens, so push does not allocate
+        void reserve(const int64_t maxLength);
+        void push(const BeamHistory &history, const int64_t row, float sumLogProbs);
         bool isDone(float bestProbs, int64_t curLength);
 
         private:
         float worstScore = 1e9;
-        std::function<bool(const std::tuple<float, std::vector<int64_t>>, const std::tuple<float, std::vector<int64_t>>)> beamsCompare = [](const std::tuple<float, std::vector<int64_t>> &a, const std::tuple<float, std::vector<int64_t>> &b)-> bool {return std::get<0>(a) > std::get<0>(b);};
+        // sequences of dropped hypotheses, reused by the next push
+        std::vector<std::vector<int64_t>> spare;
+        std::function<bool(const std::tuple<float, std::vector<int64_t>> &, const std::tuple<float, std::vector<int64_t>> &)> beamsCompare = [](const std::tuple<float, std::vector<int64_t>> &a, const std::tuple<float, std::vector<int64_t>> &b)-> bool {return std::get<0>(a) > std::get<0>(b);};
     };
 
     class SearchScorer {
@@ -34,18 +59,28 @@ namespace Inference {
 
         SearchScorer(
             const int64_t batchSize, const int64_t beamSize, const int64_t beamGroup, const int64_t padIds, const int64_t eosIds,
-            const float lengthPenalty, const bool doEarlyStop
+            const float lengthPenalty, const bool doEarlyStop, const int64_t maxLength=0
         );
 
         bool isDone();
         std::tuple<std::vector<float>, std::vector<int64_t>, std::vector<int64_t>> process(
-            std::vector<std::vector<int64_t>> &curToken, std::vector<float> &nextScore,
+            const BeamHistory &history, const std::vector<int64_t> &rowIdx, std::vector<float> &nextScore,
             std::vector<int64_t> &nextToken, std::vector<int64_t> &nextIdx
         );
+        // same into beamScore, beamToken and beamIdx of batchSize * groupSize each, which must not alias the inputs
+        void process(
+            const BeamHistory &history, const std::vector<int64_t> &rowIdx, std::vector<float> &nextScore,
+            std::vector<int64_t> &nextToken, std::vector<int64_t> &nextIdx,
+            std::vector<float> &beamScore, std::vector<int64_t> &beamToken, std::vector<int64_t> &beamIdx
+        );
         std::tuple<std::vector<std::vector<int64_t>>, std::vector<float>> finalize(
-            std::vector<std::vector<int64_t>> &curToken, std::vector<float> &finalScore,
+            const BeamHistory &history, std::vector<float> &finalScore,
             const int64_t maxLength, const int64_t returnNum
         );
+        std::tuple<std::vector<std::vector<int64_t>>, std::vector<float>> finalizeBatch(
+            const BeamHistory &history, std::vector<float> &finalScore,
+            const int64_t batchIdx, const int64_t returnNum
+        );
 
         private:
         bool isInit = false;
@@ -69,11 +104,17 @@ namespace Inference {
 
         std::vector<int64_t> currentToken();
         std::vector<int64_t> unfinishIndex();
+        // same without allocating: tokens of the decoder rows written to tokens (returns the row count) and
+        // the rows kept for the next step written to index, which keeps its capacity
+        int64_t currentToken(int64_t *tokens) const;
+        void unfinishIndex(std::vector<int64_t> &index);
 
         bool isDone();
+        bool batchDone(const int64_t batchIdx) const;
         void generate(const Ort::Value &decOutput);
+        void generate(const float *logits, const int64_t rowStride, const int64_t vocabSize);
         std::tuple<std::vector<std::vector<int64_t>>, std::vector<float>> finalize();
-        std::tuple<std::vector<str>, std::vector<float>> finalize(const std::map<int64_t, str> &rvocab);
+        std::tuple<std::vector<str>, std::vector<float>> finalize(const MolHandler::tokenTable &vocabTable);
         
         ~SearchMethods();
 
@@ -86,10 +127,98 @@ namespace Inference {
         std::vector<int64_t> unfinishIdx;
         std::vector<int64_t> groupIdx;
         std::vector<float> beamScore;
-        std::vector<std::vector<int64_t>> allToken;
+        BeamHistory history;
         SearchScorer *searchScorer;
 
-        float *finishBatchPad(const Ort::Value &decOutput, const std::vector<int64_t> &decShape);
+        // top-k candidates of the fused path, sized once so a step does not allocate
+        std::vector<float> nextTokenScore;
+        std::vector<int64_t> nextToken;
+        std::vector<int64_t> nextBeamIdx;
+        std::vector<std::pair<float, int64_t>> topkHeap;
+        std::vector<int64_t> parents;
+
+        float *finishBatchPad(const float *logits, const int64_t rowStride, const int64_t vocabSize);
+        void stepFinish(const std::vector<int64_t> &parents);
+        std::vector<str> detokenize(const std::vector<std::vector<int64_t>> &beamRes, const MolHandler::tokenTable &vocabTable);
+    };
+
+
+//----------------------------------------------------------------------------
+    // decoder inputs and outputs of one batch kept between steps, so a batch can be advanced one step at a time.
+    // reserve() allocates every buffer once for the rows of the first step and maxLength positions, the decoder reads
+    // and writes them through one IoBinding. rows only ever shrink, so later steps rewrite tokens, step counters and
+    // kept rows in place, and only the self-attention cache tensors are rebound as they grow
+    struct DecodeState {
+        int64_t curStep = 0;
+        bool finished = false;
+
+        std::vector<int64_t> msaShape, mcaShape, extraEmbShape, maskShape, taskCountShape, numListShape;
+        std::vector<int64_t> tokenShape = {0, 1};
+        std::vector<int64_t> msaOutShape = {0, 0, 0, 0};
+        std::vector<int64_t> probShape = {0, 0, 0};
+        int64_t *tokens = nullptr;
+        float *extraTokenEmb = nullptr;
+        float *msaInput = nullptr;
+        float *msaOutput = nullptr;
+        float *tokenProb = nullptr;
+        float *mcaCache = nullptr;
+        bool *contextMask = nullptr;
+        int64_t *taskCount = nullptr;
+        std::vector<int64_t> numList;
+        // rows kept for the next step, reused so finding them does not allocate
+        std::vector<int64_t> keepIdx;
+
+        std::vector<int64_t> extraQ = {2};
+        std::vector<int64_t> extraK = {2};
+        std::vector<int64_t> step = {0, 0};
+        std::vector<int64_t> scalarShape = {1};
+        std::vector<int64_t> stepShape = {2};
+
+        std::unique_ptr<Ort::IoBinding> binding;
+        // the row count or the extra tokens changed, every input is bound again before the next step
+        bool rebind = true;
+
+        DecodeState() = default;
+        DecodeState(const DecodeState &) = delete;
+        DecodeState &operator=(const DecodeState &) = delete;
+        ~DecodeState();
+
+        int64_t rows() const;
+        // buffers for the current rows and maxLength steps with vocabSize scores each, shapes have to be set
+        void reserve(const int64_t maxLength, const int64_t vocabSize);
+        // keep the decoder rows index for the next step: the kept rows of the updated self-attention cache are copied
+        // from msaOutput into msaInput (the buffers are only swapped when no row moves), the context of the rows is only compacted when rows are dropped, since a row is only ever
+        // replaced by another beam of the same molecule. the extra tokens are dropped after the first step
+        void keepRows(const std::vector<int64_t> &index);
+
+        private:
+        float *mcaSpare = nullptr;
+        bool *maskSpare = nullptr;
+        int64_t *taskSpare = nullptr;
+    };
+
+
+//----------------------------------------------------------------------------
+    // splits a batch into micro-batches of similar atom count. molecules are taken in ascending atom count and a
+    // micro-batch is closed once adding the next one would exceed byteBudget (queryIdx / keyIdx / dist plus the
+    // beam-repeated mcaCache padded to the largest graph), leave more than maxPadding of the padded mcaCache rows
+    // empty, or hold more than maxBatch molecules. a single molecule over budget still gets its own micro-batch
+    class BatchPlanner {
+        public:
+        int64_t byteBudget;
+        float maxPadding;
+        int64_t maxBatch;
+        int64_t dModel;
+
+        BatchPlanner(const int64_t byteBudget=(int64_t)256 << 20, const float maxPadding=0.3, const int64_t maxBatch=64, const int64_t dModel=256);
+
+        // heavy atom count estimated from the SMILES tokens, no parsing
+        static int64_t countAtoms(const str &smi);
+
+        int64_t estimateBytes(const int64_t batchSize, const int64_t maxAtom, const int64_t sumSquare, const int64_t beamSize) const;
+
+        // indices of smis for each micro-batch
+        std::vector<std::vector<int64_t>> plan(const std::vector<str> &smis, const int64_t beamSize) const;
     };
 
 
@@ -99,6 +228,7 @@ namespace Inference {
         std::map<str, int64_t> vocab;
         std::map<int64_t, str> rvocab;
         MolHandler::molPreprocess molHandler = MolHandler::molPreprocess();
+        BatchPlanner batchPlanner;
 
         SeqAGraphInfer(
             const modelClass &modelSelect=usptofull, const str &device="cpu",
@@ -111,6 +241,11 @@ namespace Inference {
 
         std::tuple<std::vector<str>, std::vector<float>> decoderRun(const Ort::Value &encRes, const Ort::Value &embRes, const MolHandler::inputData &mol, SearchMethods &mSearch);
 
+        void decoderPrepare(const Ort::Value &encRes, const Ort::Value &embRes, const MolHandler::inputData &mol, SearchMethods &mSearch, DecodeState &state);
+
+        // run one decoder step, return true once the batch is finished
+        bool decoderStep(SearchMethods &mSearch, DecodeState &state);
+
         std::tuple<std::vector<str>, std::vector<float>> inferRun(
             const std::vector<str> &smis, std::vector<int64_t> &lTask,
             const int64_t beamSize=20, const int64_t batchSize=1,
@@ -118,14 +253,193 @@ namespace Inference {
             const int64_t beamGroup=1, const float T=1.0, const int64_t returnNum=10, const str device="cpu"
         );
 
-        ~SeqAGraphInfer();
+        // inferRun over the micro-batches of batchPlanner, returnNum results per molecule in input order
+        std::tuple<std::vector<str>, std::vector<float>> plannedInferRun(
+            const std::vector<str> &smis, std::vector<int64_t> &lTask,
+            const int64_t beamSize=20,
+            const float lengthPenalty=1.0, const int64_t minLength=1, const int64_t maxLength=150,
+            const int64_t beamGroup=1, const float T=1.0, const int64_t returnNum=10, const str device="cpu"
+        );
+
+        // one small retro and forward inference, so the first real call does not pay arena growth and kernel selection
+        void warmUp();
+
+        // teacher-forced log-likelihood of each target (followed by <EOS>) given smis, one decoder row per pair,
+        // with the same temperature as beam search. targets longer than maxLength - 1 tokens are truncated
+        std::vector<float> scoreRun(
+            const std::vector<str> &smis, const std::vector<str> &targets, std::vector<int64_t> &lTask,
+            const float T=1.0, const int64_t maxLength=150
+        );
 
         private:
-        Ort::Env env;
-        Ort::Session *Encoder = nullptr;
-        Ort::Session *ExtraEmbedding = nullptr;
-        Ort::Session *Decoder = nullptr;
-        Ort::SessionOptions sessionOption;
+        std::shared_ptr<Ort::Session> Encoder;
+        std::shared_ptr<Ort::Session> ExtraEmbedding;
+        std::shared_ptr<Ort::Session> Decoder;
         Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
+
+        // scores per decoder row, the tokenProb dimension of the exported decoder
+        int64_t vocabSize;
+
+        // one decoder call on state.tokens, tokenProb and updatedMSACache are written to state.tokenProb and state.msaOutput
+        void decoderForward(DecodeState &state);
+    };
+
+
+//----------------------------------------------------------------------------
+    // ORT session settings applied by ModelRegistry to every session it creates. load() starts from the profile named by
+    // BIRETRO_PROFILE, then reads "key = value" lines from path (or BIRETRO_CONFIG), then BIRETRO_<KEY> variables, later
+    // sources win. keys: profile, intra_op_threads, inter_op_threads, execution_mode (sequential / parallel),
+    // graph_optimization (disable / basic / extended / all), cpu_mem_arena, mem_pattern (0 / 1). 0 threads is the ORT default
+    //   default     ORT defaults, as sessions were created before
+    //   latency     one request at a time on every core: all cores intra-op, sequential execution, full graph optimization
+    //   throughput  many concurrent Run calls: half the cores intra-op per call, parallel execution over 2 inter-op threads
+    // the intra-op counts of a profile are per session and only apply with global_thread_pool=0. on the global pools
+    // (the default) every concurrent Run shares thread_budget intra-op threads, a profile then only sets the execution
+    // mode, the inter-op pool size and the graph options
+    // optimized_cache (0 / 1) keeps ORT-optimized cpu models under cache_dir (default: ortcache/ next to the model),
+    // saved at most at the extended level, the hardware-specific layout passes of "all" run again on every load,
+    // warm_up (0 / 1) runs one small inference when a SeqAGraphInfer is first acquired,
+    // thread_budget caps the threads of the whole process (0 for every core, see MolHandler::threadBudget) and
+    // global_thread_pool (0 / 1) has all sessions share ORT pools of thread_budget intra-op and inter_op_threads (or 1)
+    // inter-op threads instead of building their own, native_value (0 / 1) has the search trees
+    // evaluate the value MLP natively instead of through ORT
+    struct InferenceConfig {
+        str profile = "default";
+        int intraOpThreads = 0;
+        int interOpThreads = 0;
+        bool parallelExecution = false;
+        GraphOptimizationLevel graphOptimization = ORT_ENABLE_ALL;
+        bool cpuMemArena = true;
+        bool memPattern = true;
+        bool optimizedCache = true;
+        str cacheDir = "";
+        bool warmUp = false;
+        int threadBudget = 0;
+        bool globalThreadPool = true;
+        bool nativeValue = false;
+
+        static InferenceConfig fromProfile(const str &name);
+        static InferenceConfig load(const str &path="");
+
+        // set one key, false if the key or the value is unknown
+        bool set(const str &key, const str &value);
+        void apply(Ort::SessionOptions &option) const;
+        str describe() const;
+    };
+
+
+//----------------------------------------------------------------------------
+    // read-only memory mapping of a whole model file, size() is 0 when the file can not be mapped
+    class MappedModel {
+        public:
+        MappedModel(const str &path);
+        ~MappedModel();
+
+        const void *data() const;
+        size_t size() const;
+
+        // FNV-1a over splitmix64-mixed 64-bit words, identifies the model content in the optimized cache together with its size
+        uint64_t hash() const;
+
+        MappedModel(const MappedModel &) = delete;
+        MappedModel &operator=(const MappedModel &) = delete;
+
+        private:
+        void *addr = nullptr;
+        size_t length = 0;
+    };
+
+
+//----------------------------------------------------------------------------
+    // process-wide model cache, all sessions share one Ort::Env and one prepacked weights container,
+    // models stay loaded until releaseUnused() is called while nobody borrows them. model files are memory mapped,
+    // cpu sessions are built from the optimized copy in the cache when one exists for the same model hash, ORT version
+    // and optimization level, otherwise ORT writes it while building the session. ORT_ENABLE_ALL output may hold
+    // layout changes for the cpu it was made on, so cache_dir should not be shared between machines.
+    // the global ORT thread pools are made with the Env from the config loaded at start-up, a later setConfig can
+    // switch sessions back to their own pools or change the thread budget but can not resize the global pools
+    class ModelRegistry {
+        public:
+        static ModelRegistry &instance();
+
+        Ort::Env &env();
+
+        // a copy taken under the lock, so a concurrent setConfig can not change it under the caller.
+        // the config only reaches sessions created afterwards, free sessions are dropped by setConfig while
+        // borrowed ones keep their options and are handed out until they are released
+        InferenceConfig config();
+        void setConfig(const InferenceConfig &newConfig);
+
+        std::shared_ptr<Ort::Session> acquireSession(const str &modelDir, const str &device="cpu");
+        std::shared_ptr<SeqAGraphInfer> acquireInfer(const modelClass &modelSelect=usptofull, const str &device="cpu");
+        int64_t releaseUnused();
+
+        ModelRegistry(const ModelRegistry &) = delete;
+        ModelRegistry &operator=(const ModelRegistry &) = delete;
+
+        private:
+        ModelRegistry();
+
+        std::recursive_mutex registryLock;
+        InferenceConfig sessionConfig;
+        bool globalThreads;
+        Ort::Env ortEnv;
+        Ort::PrepackedWeightsContainer prepackedWeights;
+        std::map<str, Ort::SessionOptions> deviceOptions;
+        std::map<str, std::shared_ptr<Ort::Session>> sessions;
+        std::map<str, std::shared_ptr<SeqAGraphInfer>> inferModels;
+
+        static Ort::Env createEnv(const InferenceConfig &config);
+        Ort::SessionOptions &sessionOption(const str &device);
+        str optimizedPath(const str &modelDir, const uint64_t modelHash, const size_t modelSize, const str &device);
+    };
+
+
+//----------------------------------------------------------------------------
+    struct inferResult {
+        std::vector<str> smis;
+        std::vector<float> scores;
+        double queueUs = 0;
+        double computeUs = 0;
+    };
+
+    // in-process single-step service, callers push requests into a lock-free queue and a dispatcher thread
+    // coalesces them (retro and forward alike) into one plannedInferRun per micro-batch. a micro-batch is sent once
+    // it holds maxBatch requests or its oldest request has waited deadlineUs
+    class InferService {
+        public:
+        const int64_t maxBatch;
+        const int64_t deadlineUs;
+
+        InferService(std::shared_ptr<SeqAGraphInfer> model, const int64_t maxBatch=16, const int64_t deadlineUs=2000, const int64_t queueSize=1024);
+
+        std::future<inferResult> submit(
+            const str &smi, const int64_t task, const int64_t beamSize=20,
+            const float lengthPenalty=0.0, const int64_t maxLength=150, const float T=1.0, const int64_t returnNum=20
+        );
+        void stop();
+
+        ~InferService();
+
+        private:
+        struct inferRequest {
+            str smi;
+            int64_t task, beamSize, maxLength, returnNum;
+            float lengthPenalty, T;
+            std::chrono::steady_clock::time_point enqueueTime;
+            std::promise<inferResult> result;
+        };
+
+        std::shared_ptr<SeqAGraphInfer> model;
+        MPMCQueue<inferRequest*> requests;
+        std::atomic<bool> running;
+        // submit calls that saw the service running and may still push, the dispatcher waits for them before it drains
+        std::atomic<int64_t> submitting{0};
+        std::mutex wakeLock;
+        std::condition_variable wakeUp;
+        std::thread dispatcher;
+
+        void dispatch();
+        void runBatch(std::vector<inferRequest*> &batch);
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace Inference {
+    // bounded lock-free multi-producer multi-consumer ring, every cell carries a sequence number
+    // telling producers and consumers whose turn it is (D. Vyukov), capacity is rounded up to a power of 2
+    template <typename T>
+    class MPMCQueue {
+        public:
+        MPMCQueue(const size_t capacity=1024){
+            size_t size = 2;
+            while (size < capacity) size <<= 1;
+            this->mask = size - 1;
+            this->cells = std::vector<cell>(size);
+            for (size_t i=0; i < size; i++) this->cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        MPMCQueue(const MPMCQueue &) = delete;
+        MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+        bool tryPush(const T &data){
+            size_t pos = this->tail.load(std::memory_order_relaxed);
+            cell *target = nullptr;
+            while (true){
+                target = &this->cells[pos & this->mask];
+                size_t seq = target->sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if (diff == 0){
+                    if (this->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                }
+                else if (diff < 0){return false;}
+                else {pos = this->tail.load(std::memory_order_relaxed);}
+            }
+            target->data = data;
+            target->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPop(T &data){
+            size_t pos = this->head.load(std::memory_order_relaxed);
+            cell *target = nullptr;
+            while (true){
+                target = &this->cells[pos & this->mask];
+                size_t seq = target->sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+                if (diff == 0){
+                    if (this->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                }
+                else if (diff < 0){return false;}
+                else {pos = this->head.load(std::memory_order_relaxed);}
+            }
+            data = std::move(target->data);
+            target->sequence.store(pos + this->mask + 1, std::memory_order_release);
+            return true;
+        }
+
+        // approximate, only meant for monitoring
+        size_t size() const {
+            size_t tailPos = this->tail.load(std::memory_order_relaxed);
+            size_t headPos = this->head.load(std::memory_order_relaxed);
+            return tailPos > headPos ? tailPos - headPos : 0;
+        }
+
+        private:
+        struct cell {
+            std::atomic<size_t> sequence;
+            T data;
+
+            cell(): sequence(0){}
+            cell(const cell &other): sequence(other.sequence.load(std::memory_order_relaxed)), data(other.data){}
+        };
+
+        size_t mask = 0;
+        std::vector<cell> cells;
+        alignas(64) std::atomic<size_t> head{0};
+        alignas(64) std::atomic<size_t> tail{0};
+    };
+}
@@ -2,6 +2,9 @@
 #include <Inference/include_head.h>
 
 namespace Inference {
+    // elements a parallel loop hands to each thread at least, loops lease their threads from MolHandler::threadBudget
+    const int64_t OMPGRAIN = 1 << 15;
+
     template <typename T>
     inline int64_t numel(const std::vector<T> &shape){
         int64_t Size = 1;
@@ -137,7 +140,8 @@ namespace Inference {
         // T *repeatData = (T *)malloc(repeatNum * sizeof(T) * count * batchSize);
         T *repeatData = new T[repeatNum * batchSize * count];
 
-        #pragma omp parallel for
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(batchSize * repeatNum * count), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
         for (int i=0; i < batchSize; i++){
             for (int j=0; j < repeatNum; j++){
                 std::copy(data + i * count, data + (i + 1) * count, repeatData + j * count + i * repeatNum * count);
@@ -156,7 +160,8 @@ namespace Inference {
         // T2 *repeatData = (T2 *)malloc(repeatNum * sizeof(T2) * count * batchSize);
         T2 *repeatData = new T2[repeatNum * batchSize * count];
 
-        #pragma omp parallel for
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(batchSize * repeatNum * count), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
         for (int i=0; i < batchSize; i++){
             for (int j=0; j < repeatNum; j++){
                 std::copy(data[i].data(), data[i].data() + count, repeatData + j * count + i * repeatNum * count);
@@ -192,7 +197,8 @@ namespace Inference {
         auto idxCount = index.size();
         T *indexData = new T[repeatCount * idxCount * copySizeCount];
 
-        #pragma omp parallel for
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(repeatCount * idxCount * copySizeCount), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
         for (int i=0; i < repeatCount; i++){
             for (int j=0; j < idxCount; j++){
                 std::copy(data + i * repeatSizeCount + index[j] * copySizeCount, data + i * repeatSizeCount + (index[j] + 1) * copySizeCount, indexData + i * copySizeCount * idxCount + j * copySizeCount);
@@ -221,7 +227,8 @@ namespace Inference {
         auto idxCount = index.size();
         T *indexData = new T[repeatCount * idxCount * copySizeCount];
 
-        #pragma omp parallel for
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(repeatCount * idxCount * copySizeCount), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
         for (int i=0; i < repeatCount; i++){
             for (int j=0; j < idxCount; j++){
                 std::copy(data + i * repeatSizeCount + index[j] * copySizeCount, data + i * repeatSizeCount + (index[j] + 1) * copySizeCount, indexData + i * copySizeCount * idxCount + j * copySizeCount);
@@ -249,7 +256,8 @@ namespace Inference {
         auto idxCount = index.size();
         std::vector<T> indexData(repeatCount * idxCount * copySizeCount);
 
-        #pragma omp parallel for
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(repeatCount * idxCount * copySizeCount), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
         for (int i=0; i < repeatCount; i++){
             for (int j=0; j < idxCount; j++){
                 std::copy(data.begin() + i * repeatSizeCount + index[j] * copySizeCount, data.begin() + i * repeatSizeCount + (index[j] + 1) * copySizeCount, indexData.begin() + i * copySizeCount * idxCount + j * copySizeCount);
@@ -277,7 +285,8 @@ namespace Inference {
         auto idxCount = index.size();
         std::vector<T> indexData(repeatCount * idxCount * copySizeCount);
 
-        #pragma omp parallel for
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(repeatCount * idxCount * copySizeCount), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
         for (int i=0; i < repeatCount; i++){
             for (int j=0; j < idxCount; j++){
                 std::copy(data.begin() + i * repeatSizeCount + index[j] * copySizeCount, data.begin() + i * repeatSizeCount + (index[j] + 1) * copySizeCount, indexData.begin() + i * copySizeCount * idxCount + j * copySizeCount);
@@ -292,11 +301,24 @@ namespace Inference {
         auto idxCount = index.size();
         std::vector<T> indexData(idxCount);
 
-        #pragma omp parallel for
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(idxCount), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
         for (int i=0; i < idxCount; i++){indexData[i] = data[index[i]];}
         return indexData;
     }
 
+    // rows index of data [*, rowSize] into out, which must not overlap data
+    template <typename T>
+    inline void indexSelectInto(const T *data, T *out, const int64_t rowSize, const std::vector<int64_t> &index){
+        auto idxCount = index.size();
+
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(idxCount * rowSize), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
+        for (int i=0; i < idxCount; i++){
+            std::copy(data + index[i] * rowSize, data + (index[i] + 1) * rowSize, out + i * rowSize);
+        }
+    }
+
     template <typename T>
     inline void indexCopy(T *data, const T *copyData, const std::vector<int64_t> &shape, const std::vector<int64_t> &index){
         int64_t dim = 0;
@@ -307,7 +329,8 @@ namespace Inference {
         for (auto i : index){assert(i < shape[dim]);}
         auto idxCount = index.size();
 
-        #pragma omp parallel for
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(idxCount * copySizeCount), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
         for (int i=0; i < idxCount; i++){
             std::copy(copyData + i * copySizeCount, copyData + (i + 1) * copySizeCount, data + index[i] * copySizeCount);
         }
@@ -320,7 +343,8 @@ namespace Inference {
         for (const auto &i : index){assert(i < data.size());}
         auto idxCount = index.size();
 
-        #pragma omp parallel for
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(idxCount * (idxCount ? copyData[0].size() : 0)), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
         for (int i=0; i < idxCount; i++){
             data[index[i]] = copyData[i];
         }
@@ -492,7 +516,8 @@ namespace Inference {
         };
 
         auto __cmp = largest ? __greater : __less;
-        #pragma omp parallel for
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(repeatCount * copyCount), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
         for (int i=0; i < repeatCount; i++){
             std::vector<T> tempData(topk);
             std::vector<int64_t> tempIdx(topk);
@@ -539,4 +564,151 @@ namespace Inference {
         if (del){delete []data;}
         return std::make_tuple(topkData, topkIdx);
     }
+
+    //--------------------------------------------------
+    #ifdef __AVX2__
+    // cephes style exp for 8 floats, relative error ~1e-7 in the range used by log-sum-exp (x <= 0)
+    inline __m256 exp256(__m256 x){
+        const __m256 one = _mm256_set1_ps(1.0f);
+        x = _mm256_min_ps(x, _mm256_set1_ps(88.3762626647949f));
+        x = _mm256_max_ps(x, _mm256_set1_ps(-88.3762626647949f));
+
+        __m256 fx = _mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504088896341f), _mm256_set1_ps(0.5f));
+        fx = _mm256_floor_ps(fx);
+        x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(0.693359375f), x);
+        x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(-2.12194440e-4f), x);
+
+        __m256 y = _mm256_set1_ps(1.9875691500E-4f);
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507E-3f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073E-3f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894E-2f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459E-1f));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201E-1f));
+        y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, one));
+
+        __m256i pow2n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(0x7f)), 23);
+        return _mm256_mul_ps(y, _mm256_castsi256_ps(pow2n));
+    }
+
+    inline float hmax256(__m256 x){
+        __m128 v = _mm_max_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+        v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_max_ss(v, _mm_movehdup_ps(v));
+        return _mm_cvtss_f32(v);
+    }
+
+    inline float hsum256(__m256 x){
+        __m128 v = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_add_ss(v, _mm_movehdup_ps(v));
+        return _mm_cvtss_f32(v);
+    }
+    #endif
+
+    // log(sum(exp(data / temperature))) of one row, max-subtracted
+    inline float rowLogSumExp(const float *data, const int64_t size, const float temperature=1.0){
+        int64_t i = 0;
+        float maxVal = -std::numeric_limits<float>::infinity();
+        #ifdef __AVX2__
+        __m256 vMax = _mm256_set1_ps(maxVal);
+        for (; i + 8 <= size; i += 8) vMax = _mm256_max_ps(vMax, _mm256_loadu_ps(data + i));
+        maxVal = hmax256(vMax);
+        #endif
+        for (; i < size; i++) maxVal = std::max(maxVal, data[i]);
+        if (maxVal == -std::numeric_limits<float>::infinity()) return maxVal;
+
+        const float shift = maxVal / temperature;
+        float sum = 0;
+        i = 0;
+        #ifdef __AVX2__
+        const __m256 vT = _mm256_set1_ps(temperature);
+        const __m256 vShift = _mm256_set1_ps(shift);
+        __m256 vSum = _mm256_setzero_ps();
+        for (; i + 8 <= size; i += 8){
+            vSum = _mm256_add_ps(vSum, exp256(_mm256_sub_ps(_mm256_div_ps(_mm256_loadu_ps(data + i), vT), vShift)));
+        }
+        sum = hsum256(vSum);
+        #endif
+        for (; i < size; i++) sum += std::exp(data[i] / temperature - shift);
+        return shift + std::log(sum);
+    }
+
+    // fused log-softmax + beam score + top-k over decoder logits, read in place
+    // logits: [aliveBatch * beamSize] rows of vocabSize floats, rowStride apart, row group k belongs to batch aliveIdx[k]
+    // beamScore: [batchSize * beamSize], outputs: [batchSize * topk] sorted descending, index = beam * vocabSize + token
+    // finished batches (not in aliveIdx) are filled with -inf / 0
+    // heapBuffer: optional [batchSize * topk] scratch, without it one buffer is allocated per call
+    inline void fusedBeamTopK(
+        const float *logits, const int64_t rowStride, const int64_t vocabSize,
+        const float *beamScore, const std::vector<int64_t> &aliveIdx,
+        const int64_t batchSize, const int64_t beamSize, const int64_t topk, const float temperature,
+        float *topkScore, int64_t *topkIdx, std::pair<float, int64_t> *heapBuffer=nullptr
+    ){
+        assert(topk <= beamSize * vocabSize);
+        std::fill(topkScore, topkScore + batchSize * topk, -std::numeric_limits<float>::infinity());
+        std::fill(topkIdx, topkIdx + batchSize * topk, 0);
+
+        std::vector<std::pair<float, int64_t>> ownHeap;
+        if (!heapBuffer){
+            ownHeap.resize(batchSize * topk);
+            heapBuffer = ownHeap.data();
+        }
+
+        const int64_t aliveCount = aliveIdx.size();
+        auto threadLease = MolHandler::threadBudget::instance().acquire(int64_t(aliveCount * beamSize * vocabSize), OMPGRAIN);
+        #pragma omp parallel for num_threads(threadLease.count()) if(threadLease.count() > 1)
+        for (int k=0; k < aliveCount; k++){
+            const int64_t batchIdx = aliveIdx[k];
+            // min-heap on score, the root is the current k-th best
+            std::pair<float, int64_t> *heap = heapBuffer + batchIdx * topk;
+            int64_t heapSize = 0;
+            auto __heapCmp = [](const std::pair<float, int64_t> &a, const std::pair<float, int64_t> &b){return a.first > b.first;};
+            auto __push = [&heap, &heapSize, &__heapCmp, &topk](const float score, const int64_t idx){
+                if (heapSize < topk){
+                    heap[heapSize++] = std::make_pair(score, idx);
+                    std::push_heap(heap, heap + heapSize, __heapCmp);
+                }
+                else if (score > heap[0].first){
+                    std::pop_heap(heap, heap + heapSize, __heapCmp);
+                    heap[heapSize - 1] = std::make_pair(score, idx);
+                    std::push_heap(heap, heap + heapSize, __heapCmp);
+                }
+            };
+
+            for (int64_t beam=0; beam < beamSize; beam++){
+                const float *row = logits + (k * beamSize + beam) * rowStride;
+                const float offset = beamScore[batchIdx * beamSize + beam] - rowLogSumExp(row, vocabSize, temperature);
+                const int64_t base = beam * vocabSize;
+                int64_t j = 0;
+
+                // fill the heap first, afterwards only tokens beating the current threshold are touched
+                for (; j < vocabSize && heapSize < topk; j++) __push(row[j] / temperature + offset, base + j);
+                if (offset == -std::numeric_limits<float>::infinity()) continue;
+
+                #ifdef __AVX2__
+                for (; j + 8 <= vocabSize; j += 8){
+                    // logits bound for the current threshold, loosened a little so rounding never drops a candidate
+                    float bound = (heap[0].first - offset) * temperature;
+                    bound -= std::abs(bound) * 1e-6f + 1e-6f;
+                    int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(row + j), _mm256_set1_ps(bound), _CMP_GT_OQ));
+                    while (mask){
+                        const int bit = __builtin_ctz(mask);
+                        __push(row[j + bit] / temperature + offset, base + j + bit);
+                        mask &= mask - 1;
+                    }
+                }
+                #endif
+                for (; j < vocabSize; j++){
+                    const float score = row[j] / temperature + offset;
+                    if (score > heap[0].first) __push(score, base + j);
+                }
+            }
+
+            std::sort_heap(heap, heap + heapSize, __heapCmp);
+            for (int64_t i=0; i < heapSize; i++){
+                topkScore[batchIdx * topk + i] = heap[i].first;
+                topkIdx[batchIdx * topk + i] = heap[i].second;
+            }
+        }
+    }
 }
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include <Inference/model_utils.h>
+
+namespace Inference {
+    BatchPlanner::BatchPlanner(const int64_t byteBudget, const float maxPadding, const int64_t maxBatch, const int64_t dModel)
+    : byteBudget(byteBudget), maxPadding(maxPadding), maxBatch(maxBatch), dModel(dModel){}
+
+    int64_t BatchPlanner::countAtoms(const str &smi){
+        int64_t atomNum = 0;
+        for (int64_t i=0; i < smi.size(); i++){
+            switch (smi[i]){
+                case '[': {
+                    while (i < smi.size() && smi[i] != ']') i++;
+                    atomNum++;
+                    break;
+                }
+                case 'B': case 'C': case 'N': case 'O': case 'S': case 'P': case 'F': case 'I':
+                case 'b': case 'c': case 'n': case 'o': case 's': case 'p': case '*': {
+                    atomNum++;
+                    break;
+                }
+                default: break;
+            }
+        }
+        return atomNum > 0 ? atomNum : 1;
+    }
+
+    int64_t BatchPlanner::estimateBytes(const int64_t batchSize, const int64_t maxAtom, const int64_t sumSquare, const int64_t beamSize) const {
+        int64_t graphBytes = 3 * sumSquare * sizeof(int64_t);
+        int64_t cacheBytes = batchSize * beamSize * maxAtom * this->dModel * sizeof(float);
+        return graphBytes + cacheBytes;
+    }
+
+    std::vector<std::vector<int64_t>> BatchPlanner::plan(const std::vector<str> &smis, const int64_t beamSize) const {
+        std::vector<int64_t> atomNums(smis.size()), order(smis.size());
+        for (int64_t i=0; i < smis.size(); i++){
+            atomNums[i] = countAtoms(smis[i]);
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](const int64_t a, const int64_t b){return atomNums[a] < atomNums[b];});
+
+        std::vector<std::vector<int64_t>> groups;
+        int64_t sumAtom = 0, sumSquare = 0;
+        for (auto idx : order){
+            const int64_t atomNum = atomNums[idx];
+            if (groups.size() > 0){
+                const int64_t batchSize = groups.back().size() + 1;
+                const int64_t newSum = sumAtom + atomNum, newSquare = sumSquare + atomNum * atomNum;
+                const float padding = 1.0 - (float)newSum / (batchSize * atomNum);
+                if (batchSize <= this->maxBatch && padding <= this->maxPadding
+                    && this->estimateBytes(batchSize, atomNum, newSquare, beamSize) <= this->byteBudget){
+                    groups.back().push_back(idx);
+                    sumAtom = newSum;
+                    sumSquare = newSquare;
+                    continue;
+                }
+            }
+            groups.push_back({idx});
+            sumAtom = atomNum;
+            sumSquare = atomNum * atomNum;
+        }
+        return groups;
+    }
+
+    std::tuple<std::vector<str>, std::vector<float>> SeqAGraphInfer::plannedInferRun(
+        const std::vector<str> &smis, std::vector<int64_t> &lTask,
+        const int64_t beamSize,
+        const float lengthPenalty, const int64_t minLength, const int64_t maxLength,
+        const int64_t beamGroup, const float T, const int64_t returnNum, const str device
+    ){
+        std::vector<str> inferRes(smis.size() * returnNum);
+        std::vector<float> inferScore(smis.size() * returnNum);
+        for (const auto &group : this->batchPlanner.plan(smis, beamSize)){
+            std::vector<str> groupSmis;
+            std::vector<int64_t> groupTask;
+            for (auto idx : group){
+                groupSmis.push_back(smis[idx]);
+                groupTask.push_back(lTask[idx]);
+            }
+            auto [groupRes, groupScore] = this->inferRun(
+                groupSmis, groupTask, beamSize, group.size(), lengthPenalty, minLength, maxLength, beamGroup, T, returnNum, device
+            );
+            for (int64_t i=0; i < group.size(); i++){
+                std::move(groupRes.begin() + i * returnNum, groupRes.begin() + (i + 1) * returnNum, inferRes.begin() + group[i] * returnNum);
+                std::copy(groupScore.begin() + i * returnNum, groupScore.begin() + (i + 1) * returnNum, inferScore.begin() + group[i] * returnNum);
+            }
+        }
+        return std::make_tuple(inferRes, inferScore);
+    }
+}
@@ -2,15 +2,61 @@
 #include <Inference/tensor_utils.h>
 
 namespace Inference{
+    BeamHistory::BeamHistory(const int64_t rows, const int64_t bosIds): rowNum(rows){
+        this->tokens = std::vector<int64_t>(rows, bosIds);
+        this->parents = std::vector<int64_t>(rows, -1);
+    }
+
+    void BeamHistory::reserve(const int64_t steps){
+        this->tokens.reserve(this->tokens.size() + steps * this->rowNum);
+        this->parents.reserve(this->parents.size() + steps * this->rowNum);
+    }
+
+    void BeamHistory::append(const std::vector<int64_t> &tokens, const std::vector<int64_t> &parents){
+        assert(tokens.size() == this->rowNum && parents.size() == this->rowNum);
+        this->tokens.insert(this->tokens.end(), tokens.begin(), tokens.end());
+        this->parents.insert(this->parents.end(), parents.begin(), parents.end());
+    }
+
+    int64_t BeamHistory::length() const {return this->rowNum ? this->tokens.size() / this->rowNum : 0;}
+
+    std::vector<int64_t> BeamHistory::trace(int64_t row) const {
+        std::vector<int64_t> hyp;
+        this->trace(row, hyp);
+        return hyp;
+    }
+
+    void BeamHistory::trace(int64_t row, std::vector<int64_t> &hyp) const {
+        hyp.resize(this->length());
+        for (int64_t step=hyp.size() - 1; step >= 0; step--){
+            hyp[step] = this->tokens[step * this->rowNum + row];
+            row = this->parents[step * this->rowNum + row];
+        }
+    }
+
     SearchHypotheses::SearchHypotheses(const int64_t beamSize, const float lengthPenalty, const bool doEarlyStop)
     :beamSize(beamSize), lengthPenalty(lengthPenalty), doEarlyStop(doEarlyStop){}
 
-    void SearchHypotheses::push(const std::vector<int64_t> &hyp, float sumLogProbs){
-        auto curScore = sumLogProbs / (pow(hyp.size(), this->lengthPenalty));
+    void SearchHypotheses::reserve(const int64_t maxLength){
+        // beamSize kept hypotheses plus the one pushed before the worst is dropped
+        this->beams.reserve(this->beamSize + 1);
+        this->spare.resize(this->beamSize + 1);
+        for (auto &hyp : this->spare) hyp.reserve(maxLength + 1);
+    }
+
+    void SearchHypotheses::push(const BeamHistory &history, const int64_t row, float sumLogProbs){
+        auto curScore = sumLogProbs / (pow(history.length(), this->lengthPenalty));
         if (this->beams.size() < this->beamSize || curScore > this->worstScore){
-            this->beams.push_back(std::make_tuple(curScore, hyp));
+            std::vector<int64_t> hyp;
+            if (this->spare.size()){
+                hyp.swap(this->spare.back());
+                this->spare.pop_back();
+            }
+            history.trace(row, hyp);
+            this->beams.emplace_back(curScore, std::move(hyp));
             std::sort(this->beams.begin(), this->beams.end(), this->beamsCompare);
             if (this->beams.size() > this->beamSize){
+                this->spare.push_back(std::move(std::get<1>(this->beams.back())));
                 this->beams.pop_back();
                 this->worstScore = std::get<0>(this->beams.back());
             }
@@ -27,11 +73,14 @@ namespace Inference{
         }
     };
 
-    SearchScorer::SearchScorer(const int64_t batchSize, const int64_t beamSize, const int64_t beamGroup, const int64_t padIds, const int64_t eosIds, const float lengthPenalty, const bool doEarlyStop): batchSize(batchSize), beamSize(beamSize), padIds(padIds), eosIds(eosIds), beamGroup(beamGroup), lengthPenalty(lengthPenalty), doEarlyStop(doEarlyStop), groupSize(beamSize / beamGroup){
+    SearchScorer::SearchScorer(const int64_t batchSize, const int64_t beamSize, const int64_t beamGroup, const int64_t padIds, const int64_t eosIds, const float lengthPenalty, const bool doEarlyStop, const int64_t maxLength): batchSize(batchSize), beamSize(beamSize), padIds(padIds), eosIds(eosIds), beamGroup(beamGroup), lengthPenalty(lengthPenalty), doEarlyStop(doEarlyStop), groupSize(beamSize / beamGroup){
         this->done = std::vector<bool>(batchSize, false);
         this->beamHyps = std::vector<SearchHypotheses>(batchSize, SearchHypotheses(
             beamSize, lengthPenalty, doEarlyStop
         ));
+        if (maxLength > 0){
+            for (auto &hyp : this->beamHyps) hyp.reserve(maxLength);
+        }
         assert(this->beamGroup <= this->beamSize);
         assert(this->beamSize % this->beamGroup == 0);
     }
@@ -39,14 +88,24 @@ namespace Inference{
     bool SearchScorer::isDone(){return std::all_of(this->done.begin(), this->done.end(), [](const bool &a){return a;});}
 
     std::tuple<std::vector<float>, std::vector<int64_t>, std::vector<int64_t>> SearchScorer::process(
-        std::vector<std::vector<int64_t>> &curToken, std::vector<float> &nextScore,
+        const BeamHistory &history, const std::vector<int64_t> &rowIdx, std::vector<float> &nextScore,
         std::vector<int64_t> &nextToken, std::vector<int64_t> &nextIdx
     ){
-        int64_t curLength = curToken[0].size();
-        int64_t candidateSize = nextScore.size() / this->batchSize;
         std::vector<float> nextBeamScore = std::vector<float>(this->batchSize * this->groupSize, 0);
         std::vector<int64_t> nextBeamToken = std::vector<int64_t>(this->batchSize * this->groupSize, 0);
         std::vector<int64_t> nextBeamIdx = std::vector<int64_t>(this->batchSize * this->groupSize, 0);
+        this->process(history, rowIdx, nextScore, nextToken, nextIdx, nextBeamScore, nextBeamToken, nextBeamIdx);
+        return std::make_tuple(nextBeamScore, nextBeamToken, nextBeamIdx);
+    }
+
+    void SearchScorer::process(
+        const BeamHistory &history, const std::vector<int64_t> &rowIdx, std::vector<float> &nextScore,
+        std::vector<int64_t> &nextToken, std::vector<int64_t> &nextIdx,
+        std::vector<float> &nextBeamScore, std::vector<int64_t> &nextBeamToken, std::vector<int64_t> &nextBeamIdx
+    ){
+        assert(nextBeamScore.size() == this->batchSize * this->groupSize);
+        int64_t curLength = history.length();
+        int64_t candidateSize = nextScore.size() / this->batchSize;
 
         int64_t beamIdx = 0;
         int64_t batchIdx = 0;
@@ -64,7 +123,7 @@ namespace Inference{
                 auto batchBeamIdx = batchIdx * this->groupSize + nextIdx[batchIdx * candidateSize + tokenRank];
                 if (nextToken[batchIdx * candidateSize + tokenRank] == this->eosIds){
                     if (tokenRank >= this->groupSize) continue;
-                    hyp.push(curToken[batchBeamIdx], nextScore[batchIdx * candidateSize + tokenRank]);
+                    hyp.push(history, rowIdx.size() ? rowIdx[batchBeamIdx] : batchBeamIdx, nextScore[batchIdx * candidateSize + tokenRank]);
                 }
                 else {
                     nextBeamScore[batchIdx * this->groupSize + beamIdx] = nextScore[batchIdx * candidateSize + tokenRank];
@@ -80,54 +139,45 @@ namespace Inference{
 
             batchIdx++;
         }
-        return std::make_tuple(nextBeamScore, nextBeamToken, nextBeamIdx);
     }
 
     std::tuple<std::vector<std::vector<int64_t>>, std::vector<float>> SearchScorer::finalize(
-        std::vector<std::vector<int64_t>> &curToken, std::vector<float> &finalScore,
+        const BeamHistory &history, std::vector<float> &finalScore,
         const int64_t maxLength, const int64_t returnNum
     ){
-        int64_t batchIdx = 0;
-        for (auto &hyp : this->beamHyps){
-            if (this->done[batchIdx]){
-                batchIdx++;
-                continue;
-            }
+        std::vector<std::vector<int64_t>> bestHyp;
+        std::vector<float> bestHypScore;
+        for (int64_t batchIdx=0; batchIdx < this->batchSize; batchIdx++){
+            auto [batchHyp, batchScore] = this->finalizeBatch(history, finalScore, batchIdx, returnNum);
+            bestHyp.insert(bestHyp.end(), std::make_move_iterator(batchHyp.begin()), std::make_move_iterator(batchHyp.end()));
+            bestHypScore.insert(bestHypScore.end(), batchScore.begin(), batchScore.end());
+        }
+        return std::make_tuple(bestHyp, bestHypScore);
+    }
+
+    std::tuple<std::vector<std::vector<int64_t>>, std::vector<float>> SearchScorer::finalizeBatch(
+        const BeamHistory &history, std::vector<float> &finalScore,
+        const int64_t batchIdx, const int64_t returnNum
+    ){
+        auto &hyp = this->beamHyps[batchIdx];
+        if (!this->done[batchIdx]){
             for (int64_t beamIdx=0; beamIdx < this->beamSize; beamIdx++){
                 auto batchBeamIdx = batchIdx * this->beamSize + beamIdx;
-                hyp.push(curToken[batchBeamIdx], finalScore[batchBeamIdx]);
+                hyp.push(history, batchBeamIdx, finalScore[batchBeamIdx]);
             }
-            batchIdx++;
+            // open beams are stored only once
+            this->done[batchIdx] = true;
         }
 
-        std::vector<int64_t> resLength(this->batchSize * returnNum);
         std::vector<std::vector<int64_t>> bestHyp;
-        std::vector<float> bestHypScore(this->batchSize * returnNum, 0);
-
-        int64_t hypIdx = 0;
-        for (auto &hyp : this->beamHyps){
-            for (int64_t beamIdx=0; beamIdx < returnNum; beamIdx++){
-                auto [hypScore, hypRes] = hyp.beams[beamIdx];
-                bestHypScore[returnNum * hypIdx + beamIdx] = hypScore;
-                //remove ["<BOS>"]
-                resLength[returnNum * hypIdx + beamIdx] = hypRes.size() - 1;
-                bestHyp.push_back(std::vector<int64_t>(hypRes.begin() + 1, hypRes.end()));
-            }
-            hypIdx++;
+        std::vector<float> bestHypScore(returnNum, 0);
+        for (int64_t beamIdx=0; beamIdx < returnNum; beamIdx++){
+            auto &[hypScore, hypRes] = hyp.beams[beamIdx];
+            bestHypScore[beamIdx] = hypScore;
+            //remove ["<BOS>"]
+            bestHyp.push_back(std::vector<int64_t>(hypRes.begin() + 1, hypRes.end()));
         }
         return std::make_tuple(bestHyp, bestHypScore);
-
-        //no need to padding
-        // auto resMaxLength = *(std::max(resLength.begin(), resLength.end())) + 1;
-        // if (resMaxLength > maxLength) resMaxLength = maxLength;
-        // std::vector<std::vector<int64_t>> res(this->batchSize * this->beamSize, std::vector<int64_t>(resMaxLength, this->padIds));
-
-        // for (int64_t i=0; i < bestHyp.size(); i++){
-        //     auto copyLength = resLength[i] < res[i].size() ? resLength[i] : res[i].size();
-        //     std::copy(bestHyp[i].begin(), bestHyp[i].begin() + copyLength, res[i].begin());
-        //     if (copyLength == resLength[i]){res[i][copyLength] = this->eosIds;}
-        // }
-        // return std::make_tuple(res, bestHypScore);
     }
 
     SearchMethods::SearchMethods(
@@ -138,8 +188,9 @@ namespace Inference{
     ): beamSize(beamSize), batchSize(batchSize), bosIds(bosIds), padIds(padIds), eosIds(eosIds), lengthPenalty(lengthPenalty), minLength(minLength), maxLength(maxLength), beamGroup(beamGroup), T(T), returnNum(returnNum), device(device), groupSize(beamSize / beamGroup){
         assert(this->returnNum <= this->beamSize);
         this->curToken = std::vector<int64_t>(batchSize * beamSize, bosIds);
-        this->allToken = std::vector<std::vector<int64_t>>(batchSize * beamSize, std::vector<int64_t>(1, bosIds));
-        this->searchScorer = new SearchScorer(batchSize, beamSize, beamGroup, padIds, eosIds, lengthPenalty, false);
+        this->history = BeamHistory(batchSize * beamSize, bosIds);
+        this->searchScorer = new SearchScorer(batchSize, beamSize, beamGroup, padIds, eosIds, lengthPenalty, false, maxLength);
+        this->history.reserve(maxLength);
 
         this->beamScore = std::vector<float>(batchSize * beamSize, -std::numeric_limits<float>::infinity());
         for (int i=0; i < batchSize * beamGroup; i++){this->beamScore[i * this->groupSize] = 0;}
@@ -157,11 +208,20 @@ namespace Inference{
         this->aliveIdx = std::vector<int64_t>(batchSize * beamSize);
         std::copy(this->beamIdx.begin(), this->beamIdx.end(), this->aliveIdx.begin());
         this->unfinishIdx = indexGenerate(this->searchScorer->done, false);
+
+        this->nextTokenScore = std::vector<float>(batchSize * beamSize * 2);
+        this->nextToken = std::vector<int64_t>(batchSize * beamSize * 2);
+        this->nextBeamIdx = std::vector<int64_t>(batchSize * beamSize * 2);
+        this->topkHeap = std::vector<std::pair<float, int64_t>>(batchSize * beamSize * 2);
+        this->parents = std::vector<int64_t>(batchSize * beamSize);
     }
 
     SearchMethods::~SearchMethods(){delete searchScorer;}
 
-    bool SearchMethods::isDone(){return (this->searchScorer->isDone() || this->allToken[0].size() >= this->maxLength);}
+    bool SearchMethods::isDone(){return (this->searchScorer->isDone() || this->history.length() >= this->maxLength);}
+
+    bool SearchMethods::batchDone(const int64_t batchIdx) const {return this->searchScorer->done[batchIdx];}
+
 
     std::vector<int64_t> SearchMethods::currentToken(){
         if (this->unfinishIdx.size() < this->batchSize){
@@ -170,34 +230,72 @@ namespace Inference{
         else {return this->curToken;}
     }
 
+    int64_t SearchMethods::currentToken(int64_t *tokens) const {
+        for (int64_t k=0; k < this->unfinishIdx.size(); k++){
+            const auto src = this->curToken.begin() + this->unfinishIdx[k] * this->beamSize;
+            std::copy(src, src + this->beamSize, tokens + k * this->beamSize);
+        }
+        return this->unfinishIdx.size() * this->beamSize;
+    }
+
     std::vector<int64_t> SearchMethods::unfinishIndex(){
+        std::vector<int64_t> index;
+        this->unfinishIndex(index);
+        return index;
+    }
+
+    void SearchMethods::unfinishIndex(std::vector<int64_t> &index){
         if (this->unfinishIdx.size() < this->batchSize){
-            auto unfinish = std::get<0>(indexSelect(this->beamIdx, {this->batchSize, this->beamSize}, this->unfinishIdx, 0));
-            if (this->aliveBatch.size() < this->batchSize){
-                std::vector<int64_t> aliveArange(this->aliveBatch.size() * this->beamSize);
-                std::iota(aliveArange.begin(), aliveArange.end(), 0);
-                indexCopy(this->aliveIdx.data(), aliveArange.data(), {this->batchSize, this->beamSize}, this->aliveBatch);
-                unfinish = std::get<0>(indexSelect(this->aliveIdx, {this->batchSize * this->beamSize}, unfinish, 0));
+            // decoder rows of the last step hold the alive batches in order, parents are mapped to those rows
+            const bool compact = this->aliveBatch.size() < this->batchSize;
+            if (compact){
+                for (int64_t k=0; k < this->aliveBatch.size(); k++){
+                    std::iota(this->aliveIdx.begin() + this->aliveBatch[k] * this->beamSize, this->aliveIdx.begin() + (this->aliveBatch[k] + 1) * this->beamSize, k * this->beamSize);
+                }
+            }
+            index.clear();
+            for (auto batchIdx : this->unfinishIdx){
+                for (int64_t beam=0; beam < this->beamSize; beam++){
+                    const int64_t parent = this->beamIdx[batchIdx * this->beamSize + beam];
+                    index.push_back(compact ? this->aliveIdx[parent] : parent);
+                }
             }
             this->aliveBatch = this->unfinishIdx;
-            return unfinish;
         }
-        else {return this->beamIdx;}
+        else {index.assign(this->beamIdx.begin(), this->beamIdx.end());}
     }
 
-    float *SearchMethods::finishBatchPad(const Ort::Value &decOutput, const std::vector<int64_t> &decShape){
-        float *decVecPtr = new float[this->batchSize * this->beamSize * decShape.back()]();
-        if (decShape[0] < this->batchSize * this->beamSize){
-            indexCopy(decVecPtr, decOutput.GetTensorData<float>(), {this->batchSize, this->beamSize * decShape.back()}, this->unfinishIdx);
+    float *SearchMethods::finishBatchPad(const float *logits, const int64_t rowStride, const int64_t vocabSize){
+        float *decVecPtr = new float[this->batchSize * this->beamSize * vocabSize]();
+        for (int64_t k=0; k < this->unfinishIdx.size(); k++){
+            for (int64_t beam=0; beam < this->beamSize; beam++){
+                const float *row = logits + (k * this->beamSize + beam) * rowStride;
+                std::copy(row, row + vocabSize, decVecPtr + (this->unfinishIdx[k] * this->beamSize + beam) * vocabSize);
+            }
         }
-        else {std::copy(decOutput.GetTensorData<float>(), decOutput.GetTensorData<float>() + numel(decShape), decVecPtr);}
         return decVecPtr;
     };
 
     void SearchMethods::generate(const Ort::Value &decOutput){
         std::vector<int64_t> decOutShape = decOutput.GetTensorTypeAndShapeInfo().GetShape();
-        int64_t vocabSize = decOutShape.back();
-        auto padDecOut = this->finishBatchPad(decOutput, decOutShape);
+        this->generate(decOutput.GetTensorData<float>(), decOutShape.back(), decOutShape.back());
+    }
+
+    void SearchMethods::generate(const float *logits, const int64_t rowStride, const int64_t vocabSize){
+        if (this->beamGroup == 1){
+            // fused path, logits are read in place and every buffer is a member, a step does not allocate
+            const int64_t topk = this->beamSize * 2;
+            fusedBeamTopK(logits, rowStride, vocabSize, this->beamScore.data(), this->unfinishIdx, this->batchSize, this->beamSize, topk, this->T, this->nextTokenScore.data(), this->nextToken.data(), this->topkHeap.data());
+
+            std::transform(this->nextToken.begin(), this->nextToken.end(), this->nextBeamIdx.begin(), [&vocabSize](const int64_t &a){return a / vocabSize;});
+            std::for_each(this->nextToken.begin(), this->nextToken.end(), [&vocabSize](int64_t &a){a = a % vocabSize;});
+            const std::vector<int64_t> noRowIdx;
+            this->searchScorer->process(this->history, noRowIdx, this->nextTokenScore, this->nextToken, this->nextBeamIdx, this->beamScore, this->curToken, this->beamIdx);
+            this->stepFinish(this->beamIdx);
+            return;
+        }
+
+        auto padDecOut = this->finishBatchPad(logits, rowStride, vocabSize);
         std::vector<int64_t> padDecShape = {this->batchSize * this->beamSize, vocabSize};
         lastSoftmax(padDecOut, padDecShape, this->T, true);
         
@@ -207,13 +305,15 @@ namespace Inference{
         }
         padDecShape = {this->batchSize, this->beamGroup, this->groupSize * vocabSize};
 
+        // grouped beams keep the padded softmax + topk path
+        auto &parents = this->parents;
+        std::iota(parents.begin(), parents.end(), 0);
         if (this->beamGroup > 1){
             for (int groupId=0; groupId < this->beamGroup; groupId++){
                 std::vector<int64_t> groupIdx = {};
                 for (int i=0; i < this->groupIdx.size(); i++){
                     if (groupId == this->groupIdx[i]){groupIdx.push_back(i);}
                 }
-                auto groupAllToken = firstIndexSelect(this->allToken, groupIdx);
                 auto [groupLogit, groupShape] = indexSelect(padDecOut, std::move(padDecShape), {groupId}, 1, false);
                 groupShape.erase(groupShape.begin() + 1);
                 auto [nextTokenScore, nextToken] = lastTopK(groupLogit, groupShape, this->groupSize * 2, true, false);
@@ -221,11 +321,11 @@ namespace Inference{
                 std::vector<int64_t> nextBeamIdx(nextToken.size());
                 std::transform(nextToken.begin(), nextToken.end(), nextBeamIdx.begin(), [&vocabSize](const int64_t &a){return a / vocabSize;});
                 std::for_each(nextToken.begin(), nextToken.end(), [&vocabSize](int64_t &a){a = a % vocabSize;});
-                auto beamRes = this->searchScorer->process(groupAllToken, nextTokenScore, nextToken, nextBeamIdx);
+                auto beamRes = this->searchScorer->process(this->history, groupIdx, nextTokenScore, nextToken, nextBeamIdx);
                 nextBeamIdx = std::get<2>(beamRes);
 
                 indexCopy(this->beamScore.data(), std::get<0>(beamRes).data(), {this->batchSize * this->beamSize}, groupIdx);
-                indexCopy(this->allToken, firstIndexSelect(groupAllToken, nextBeamIdx), groupIdx);
+                for (int i=0; i < std::min(nextBeamIdx.size(), groupIdx.size()); i++){parents[groupIdx[i]] = groupIdx[nextBeamIdx[i]];}
                 indexCopy(this->curToken.data(), std::get<1>(beamRes).data(), {this->batchSize * this->beamSize}, groupIdx);
 
                 std::vector<int64_t> updateBeamIdx(this->batchSize * this->groupIdx.size());
@@ -233,41 +333,39 @@ namespace Inference{
                 indexCopy(this->beamIdx.data(), nextBeamIdx.data(), {this->batchSize * this->beamSize}, groupIdx);
             }
         }
-        else {
-            auto [nextTokenScore, nextToken] = lastTopK(padDecOut, padDecShape, this->beamSize * 2, true, false);
-            std::vector<int64_t> nextBeamIdx(nextToken.size());
-            std::transform(nextToken.begin(), nextToken.end(), nextBeamIdx.begin(), [&vocabSize](const int64_t &a){return a / vocabSize;});
-            std::for_each(nextToken.begin(), nextToken.end(), [&vocabSize](int64_t &a){a = a % vocabSize;});
-            auto beamRes = this->searchScorer->process(this->allToken, nextTokenScore, nextToken, nextBeamIdx);
-
-            this->allToken = firstIndexSelect(this->allToken, std::get<2>(beamRes));
-            this->beamScore = std::get<0>(beamRes);
-            this->curToken = std::get<1>(beamRes);
-            this->beamIdx = std::get<2>(beamRes);
-        }
         delete []padDecOut;
-        for (int i=0; i < this->allToken.size(); i++){this->allToken[i].push_back(this->curToken[i]);}
+        this->stepFinish(parents);
+    }
+
+    void SearchMethods::stepFinish(const std::vector<int64_t> &parents){
+        this->history.append(this->curToken, parents);
         if (std::any_of(this->searchScorer->done.begin(), this->searchScorer->done.end(), [](const bool &a){return a;})){
-            this->unfinishIdx = indexGenerate(this->searchScorer->done, false);
+            // rewritten in place, its capacity is batchSize
+            this->unfinishIdx.clear();
+            for (int64_t b=0; b < this->batchSize; b++){
+                if (!this->searchScorer->done[b]) this->unfinishIdx.push_back(b);
+            }
         }
     }
 
     std::tuple<std::vector<std::vector<int64_t>>, std::vector<float>> SearchMethods::finalize(){
-        return this->searchScorer->finalize(this->allToken, this->beamScore, this->maxLength, this->returnNum);
+        return this->searchScorer->finalize(this->history, this->beamScore, this->maxLength, this->returnNum);
     }
 
-    std::tuple<std::vector<str>, std::vector<float>> SearchMethods::finalize(const std::map<int64_t, str> &rvocab){
-        auto [beamRes, beamScore] = this->searchScorer->finalize(this->allToken, this->beamScore, this->maxLength, this->returnNum);
-        std::vector<str> beamStrRes;
+    std::tuple<std::vector<str>, std::vector<float>> SearchMethods::finalize(const MolHandler::tokenTable &vocabTable){
+        auto [beamRes, beamScore] = this->searchScorer->finalize(this->history, this->beamScore, this->maxLength, this->returnNum);
+        return std::make_tuple(this->detokenize(beamRes, vocabTable), beamScore);
+    }
 
+    std::vector<str> SearchMethods::detokenize(const std::vector<std::vector<int64_t>> &beamRes, const MolHandler::tokenTable &vocabTable){
+        std::vector<str> beamStrRes(beamRes.size());
         for (int i=0; i < beamRes.size(); i++){
-            str tempRes = "";
-            for (auto idx : beamRes[i]){
-                auto findRes = rvocab.find(idx);
-                if (findRes != rvocab.end()){tempRes += findRes->second;}
-            }
-            beamStrRes.push_back(tempRes);
+            size_t length = 0;
+            for (auto idx : beamRes[i]){length += vocabTable.token(idx).size();}
+            auto &tempRes = beamStrRes[i];
+            tempRes.reserve(length);
+            for (auto idx : beamRes[i]){tempRes += vocabTable.token(idx);}
         }
-        return std::make_tuple(beamStrRes, beamScore);
+        return beamStrRes;
     }
-}
\ No newline at end of file
+}
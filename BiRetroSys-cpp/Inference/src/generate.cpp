@@ -29,23 +29,22 @@ namespace Inference {
         }
 
         //load preprocessor
-        this->molHandler.vocab = this->vocab;
+        this->molHandler.setVocabulary(this->vocab);
 
-        //load model
-        if (device == "cuda"){
-            OrtCUDAProviderOptions cudaOption;
-            cudaOption.device_id = 0;
-            this->sessionOption.AppendExecutionProvider_CUDA(cudaOption);
-        }
-        Encoder = new Ort::Session(this->env, modelDir[0].c_str(), this->sessionOption);
-        ExtraEmbedding = new Ort::Session(this->env, modelDir[1].c_str(), this->sessionOption);
-        Decoder = new Ort::Session(this->env, modelDir[2].c_str(), this->sessionOption);
-    }
+        //load model, sessions are borrowed from the registry so each model file is loaded once per process
+        auto &registry = ModelRegistry::instance();
+        Encoder = registry.acquireSession(modelDir[0], device);
+        ExtraEmbedding = registry.acquireSession(modelDir[1], device);
+        Decoder = registry.acquireSession(modelDir[2], device);
 
-    SeqAGraphInfer::~SeqAGraphInfer(){
-        delete Encoder;
-        delete ExtraEmbedding;
-        delete Decoder;
+        // tokenProb is written into a buffer of this many scores per row, the vocabulary size if the export left it dynamic
+        this->vocabSize = this->rvocab.size();
+        Ort::AllocatorWithDefaultOptions allocator;
+        for (size_t i=0; i < Decoder->GetOutputCount(); i++){
+            if (str(Decoder->GetOutputNameAllocated(i, allocator).get()) != "tokenProb") continue;
+            auto probShape = Decoder->GetOutputTypeInfo(i).GetTensorTypeAndShapeInfo().GetShape();
+            if (probShape.size() && probShape.back() > 0) this->vocabSize = probShape.back();
+        }
     }
 
     std::vector<Ort::Value> SeqAGraphInfer::encoderRun(MolHandler::inputData &mol){
@@ -105,13 +104,105 @@ namespace Inference {
         );
     }
 
+    DecodeState::~DecodeState(){
+        delete []tokens;
+        delete []extraTokenEmb;
+        delete []msaInput;
+        delete []msaOutput;
+        delete []tokenProb;
+        delete []mcaCache;
+        delete []mcaSpare;
+        delete []taskCount;
+        delete []taskSpare;
+        delete []contextMask;
+        delete []maskSpare;
+    }
+
+    int64_t DecodeState::rows() const {return this->mcaShape[0];}
+
+    void DecodeState::reserve(const int64_t maxLength, const int64_t vocabSize){
+        const int64_t rows = this->rows();
+        const int64_t layers = this->msaShape[0];
+        const int64_t dModel = this->msaShape[3];
+        // the extra tokens stay in the self-attention cache after the first step
+        const int64_t positions = this->extraK[0] + maxLength;
+        const int64_t queryLength = this->extraQ[0] + 1;
+
+        // left uninitialized, pages of the large buffers are only committed once a step reaches them
+        this->tokens = new int64_t[rows];
+        this->msaInput = new float[layers * rows * positions * dModel];
+        this->msaOutput = new float[layers * rows * positions * dModel];
+        this->tokenProb = new float[rows * queryLength * vocabSize];
+        this->mcaSpare = new float[numel(this->mcaShape)];
+        this->maskSpare = new bool[numel(this->maskShape)];
+        this->taskSpare = new int64_t[rows];
+        this->keepIdx.reserve(rows);
+
+        this->tokenShape = {rows, 1};
+        this->probShape = {rows, queryLength, vocabSize};
+        this->rebind = true;
+    }
+
+    void DecodeState::keepRows(const std::vector<int64_t> &index){
+        const int64_t rows = this->rows();
+        // the extra tokens are only attended at the first step, the first query row of every mask is moved down in place
+        if (this->extraQ[0] > 0){
+            const int64_t queryLength = this->maskShape[2];
+            const int64_t keyLength = this->maskShape[3];
+            for (int64_t r=1; r < rows; r++){
+                std::copy(this->contextMask + r * queryLength * keyLength, this->contextMask + (r * queryLength + 1) * keyLength, this->contextMask + r * keyLength);
+            }
+            this->maskShape[2] = 1;
+            this->extraEmbShape[1] = 0;
+            this->extraQ[0] = 0;
+            this->rebind = true;
+        }
+
+        // the exported decoder reads msaCache as one contiguous tensor, so the kept rows are still copied in full every
+        // step, O(L) per row. the output buffer is the copy source, no third buffer is kept
+        const int64_t keepCount = index.size();
+        bool inPlace = keepCount == rows;
+        for (int64_t r=0; inPlace && r < keepCount; r++) inPlace = index[r] == r;
+        if (inPlace){std::swap(this->msaInput, this->msaOutput);}
+        else {
+            const int64_t rowSize = this->msaOutShape[2] * this->msaOutShape[3];
+            for (int64_t l=0; l < this->msaOutShape[0]; l++){
+                indexSelectInto(this->msaOutput + l * rows * rowSize, this->msaInput + l * keepCount * rowSize, rowSize, index);
+            }
+        }
+        this->msaShape = {this->msaOutShape[0], keepCount, this->msaOutShape[2], this->msaOutShape[3]};
+
+        if (keepCount != rows){
+            indexSelectInto(this->mcaCache, this->mcaSpare, numel(this->mcaShape) / rows, index);
+            indexSelectInto(this->contextMask, this->maskSpare, numel(this->maskShape) / rows, index);
+            indexSelectInto(this->taskCount, this->taskSpare, 1, index);
+            std::swap(this->mcaCache, this->mcaSpare);
+            std::swap(this->contextMask, this->maskSpare);
+            std::swap(this->taskCount, this->taskSpare);
+            this->mcaShape[0] = this->maskShape[0] = this->taskCountShape[0] = this->tokenShape[0] = keepCount;
+
+            std::fill(this->numList.begin(), this->numList.end(), 0);
+            for (int64_t r=0; r < keepCount; r++) this->numList[this->taskCount[r]]++;
+            this->rebind = true;
+        }
+        this->probShape[0] = keepCount;
+        this->probShape[1] = this->extraQ[0] + 1;
+    }
+
     std::tuple<std::vector<str>, std::vector<float>> SeqAGraphInfer::decoderRun(
         const Ort::Value &encRes, const Ort::Value &embRes, const MolHandler::inputData &mol,
         SearchMethods &mSearch
     ){
-        const std::vector<const char*> inputsName = {"tokens", "extraTokenEmb", "msaCache", "mcaCache", "contextMask", "extraQ", "extraK", "numList", "step"};
-        const std::vector<const char*> outputsName = {"tokenProb", "updatedMSACache"};
+        DecodeState state;
+        this->decoderPrepare(encRes, embRes, mol, mSearch, state);
+        while (!this->decoderStep(mSearch, state)){}
+        return mSearch.finalize(this->molHandler.vocabTable);
+    }
 
+    void SeqAGraphInfer::decoderPrepare(
+        const Ort::Value &encRes, const Ort::Value &embRes, const MolHandler::inputData &mol,
+        SearchMethods &mSearch, DecodeState &state
+    ){
         auto graphEmb = graphPadding(
             encRes.GetTensorData<float>(),
             encRes.GetTensorTypeAndShapeInfo().GetShape(),
@@ -121,93 +212,132 @@ namespace Inference {
         int64_t batchSize = graphEmb.size();
         int64_t dModel = graphEmb[0].cols();
 
-        std::vector<int64_t> msaShape = {8, batchSize * mSearch.beamSize, 0, dModel};
-        std::vector<int64_t> mcaShape = {batchSize, graphEmb[0].rows(), dModel};
-        std::vector<int64_t> extraEmbShape = embRes.GetTensorTypeAndShapeInfo().GetShape();
-        std::vector<int64_t> maskShape = {batchSize, 1, mask[0].rows(), mask[0].cols()};
-        std::vector<int64_t> taskCountShape = {batchSize};
-        std::vector<int64_t> numListShape = {2};
-
-        float *extraTokenEmb = nullptr;
-        float *msaCache = nullptr;
-        float *mcaCache = nullptr;
-        bool *contextMask = nullptr;
-        int64_t *taskCount = nullptr;
-        std::vector<int64_t> numList;
-
-        std::vector<int64_t> extraQShape = {1};
-        std::vector<int64_t> extraKShape = {1};
-        std::vector<int64_t> stepShape = {2};
-        std::vector<int64_t> extraQ = {2};
-        std::vector<int64_t> extraK = {2};
-        std::vector<int64_t> step = {0, 0};
-        std::vector<int64_t> inputTokenShape = {0, 1};
-
-        for (int i=0, maxStep=mSearch.maxLength; i < maxStep; i++){
-            std::vector<Ort::Value> inputs;
-            auto inputToken = mSearch.currentToken();
-            inputTokenShape[0] = inputToken.size();
-            step[0] = i;
-
-            if (i == 0){
-                //beam repeat
-                extraTokenEmb = batchRepeatInterleave(embRes.GetTensorData<float>(), extraEmbShape, mSearch.beamSize, false);
-                mcaCache = batchRepeatInterleave<MatRX<float>, float>(graphEmb, mcaShape, mSearch.beamSize);
-                contextMask = batchRepeatInterleave<MatRX<bool>, bool>(mask, maskShape, mSearch.beamSize);
-                taskCount = batchRepeatInterleave(mol.lTask.data(), taskCountShape, mSearch.beamSize, false);
-                numList = constBinCount(taskCount, taskCountShape[0], {0, 1});
-                numListShape[0] = numList.size();
+        state.msaShape = {8, batchSize * mSearch.beamSize, 0, dModel};
+        state.mcaShape = {batchSize, graphEmb[0].rows(), dModel};
+        state.extraEmbShape = embRes.GetTensorTypeAndShapeInfo().GetShape();
+        state.maskShape = {batchSize, 1, mask[0].rows(), mask[0].cols()};
+        state.taskCountShape = {batchSize};
+        state.numListShape = {2};
+
+        //beam repeat
+        state.extraTokenEmb = batchRepeatInterleave(embRes.GetTensorData<float>(), state.extraEmbShape, mSearch.beamSize, false);
+        state.mcaCache = batchRepeatInterleave<MatRX<float>, float>(graphEmb, state.mcaShape, mSearch.beamSize);
+        state.contextMask = batchRepeatInterleave<MatRX<bool>, bool>(mask, state.maskShape, mSearch.beamSize);
+        state.taskCount = batchRepeatInterleave(mol.lTask.data(), state.taskCountShape, mSearch.beamSize, false);
+        state.numList = constBinCount(state.taskCount, state.taskCountShape[0], {0, 1});
+        state.numListShape[0] = state.numList.size();
+
+        state.reserve(mSearch.maxLength, this->vocabSize);
+        state.binding = std::make_unique<Ort::IoBinding>(*this->Decoder);
+    }
+
+    bool SeqAGraphInfer::decoderStep(SearchMethods &mSearch, DecodeState &state){
+        if (state.finished){return true;}
+
+        mSearch.currentToken(state.tokens);
+        this->decoderForward(state);
+        // [rows, queryLength, vocab], only the position after the extra tokens is scored
+        const int64_t queryLength = state.probShape[1];
+        const int64_t vocabSize = state.probShape[2];
+        mSearch.generate(state.tokenProb + (queryLength - 1) * vocabSize, queryLength * vocabSize, vocabSize);
+
+        state.curStep++;
+        if (mSearch.isDone() || state.curStep >= mSearch.maxLength){
+            state.finished = true;
+            return true;
+        }
+        mSearch.unfinishIndex(state.keepIdx);
+        state.keepRows(state.keepIdx);
+        return false;
+    }
+
+    void SeqAGraphInfer::decoderForward(DecodeState &state){
+        auto &binding = *state.binding;
+        state.step[0] = state.curStep;
+        state.msaOutShape = {state.msaShape[0], state.msaShape[1], state.msaShape[2] + state.extraQ[0] + 1, state.msaShape[3]};
+
+        // tokens, step counters and the kept rows are updated in place, their tensors only change with the row count
+        if (state.rebind){
+            binding.BindInput("tokens", convertTensor<int64_t, int64_t>(state.tokens, state.tokenShape, this->memInfo));
+            binding.BindInput("extraTokenEmb", convertTensor<float, float>(state.extraTokenEmb, state.extraEmbShape, this->memInfo));
+            binding.BindInput("mcaCache", convertTensor<float, float>(state.mcaCache, state.mcaShape, this->memInfo));
+            binding.BindInput("contextMask", convertTensor<bool, bool>(state.contextMask, state.maskShape, this->memInfo));
+            binding.BindInput("extraQ", convertTensor<int64_t, int64_t>(state.extraQ.data(), state.scalarShape, this->memInfo));
+            binding.BindInput("extraK", convertTensor<int64_t, int64_t>(state.extraK.data(), state.scalarShape, this->memInfo));
+            binding.BindInput("numList", convertTensor<int64_t, int64_t>(state.numList.data(), state.numListShape, this->memInfo));
+            binding.BindInput("step", convertTensor<int64_t, int64_t>(state.step.data(), state.stepShape, this->memInfo));
+            binding.BindOutput("tokenProb", convertTensor<float, float>(state.tokenProb, state.probShape, this->memInfo));
+            state.rebind = false;
+        }
+        // the self-attention cache grows by one position per step
+        binding.BindInput("msaCache", convertTensor<float, float>(state.msaInput, state.msaShape, this->memInfo));
+        binding.BindOutput("updatedMSACache", convertTensor<float, float>(state.msaOutput, state.msaOutShape, this->memInfo));
+
+        this->Decoder->Run(Ort::RunOptions{nullptr}, binding);
+    }
+
+    void SeqAGraphInfer::warmUp(){
+        std::vector<str> smis = {"CC(=O)Oc1ccccc1C(=O)O", "CC(=O)Oc1ccccc1C(=O)O"};
+        std::vector<int64_t> lTask = {0, 1};
+        this->inferRun(smis, lTask, 20, smis.size(), 0.0, 1, 16, 1, 1.0, 1);
+    }
+
+    std::vector<float> SeqAGraphInfer::scoreRun(
+        const std::vector<str> &smis, const std::vector<str> &targets, std::vector<int64_t> &lTask,
+        const float T, const int64_t maxLength
+    ){
+        assert(smis.size() == targets.size() && smis.size() == lTask.size());
+        std::vector<float> res(smis.size(), 0);
+        const int64_t eosId = this->vocab["<EOS>"];
+
+        for (auto &group : this->batchPlanner.plan(smis, 1)){
+            const int64_t batchSize = group.size();
+            std::vector<str> groupSmis;
+            std::vector<int64_t> groupTask;
+            std::vector<std::vector<int64_t>> targetIds(batchSize);
+            for (int64_t i=0; i < batchSize; i++){
+                groupSmis.push_back(smis[group[i]]);
+                groupTask.push_back(lTask[group[i]]);
+                // the decoder was trained on canonical output, a raw product would score near zero
+                auto seq = this->molHandler.generateSeq(std::get<0>(this->molHandler.canonicalizeSmiles(targets[group[i]])));
+                targetIds[i].assign(seq.data(), seq.data() + std::min<int64_t>(seq.cols(), maxLength - 1));
+                targetIds[i].push_back(eosId);
             }
-            inputs.push_back(std::move(
-                Ort::Value::CreateTensor<int64_t>(this->memInfo, inputToken.data(), inputToken.size(), inputTokenShape.data(), inputTokenShape.size())
-            ));
-            inputs.push_back(std::move(convertTensor<float, float>(extraTokenEmb, extraEmbShape, this->memInfo)));
-            inputs.push_back(std::move(convertTensor<float, float>(msaCache, msaShape, this->memInfo)));
-            inputs.push_back(std::move(convertTensor<float, float>(mcaCache, mcaShape, this->memInfo)));
-            inputs.push_back(std::move(convertTensor<bool, bool>(contextMask, maskShape, this->memInfo)));
-            inputs.push_back(std::move(convertTensor<int64_t, int64_t>(extraQ.data(), extraQShape, this->memInfo)));
-            inputs.push_back(std::move(convertTensor<int64_t, int64_t>(extraK.data(), extraKShape, this->memInfo)));
-            inputs.push_back(std::move(convertTensor<int64_t, int64_t>(numList.data(), numListShape, this->memInfo)));
-            inputs.push_back(std::move(convertTensor<int64_t, int64_t>(step.data(), stepShape, this->memInfo)));
-
-            auto outputs = this->Decoder->Run(
-                Ort::RunOptions{nullptr},
-                inputsName.data(), 
-                inputs.data(), inputs.size(),
-                outputsName.data(), outputsName.size()
-            );
-
-            if (i == 0){
-                auto tokenProbShape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
-                auto tokenProb = indexSelect(outputs[0].GetTensorData<float>(), tokenProbShape, {2}, 1, false);
-
-                mSearch.generate(convertTensor<float, float>(tokenProb, tokenProbShape, this->memInfo));
-                
-                delete []tokenProb;
-                delete []extraTokenEmb;
-                extraTokenEmb = nullptr;
-                contextMask = indexSelect(contextMask, maskShape, {0}, 2);
-                extraEmbShape[1] = 0;
-                extraQ[0] = 0;
+
+            auto batch = this->molHandler.generateBatch(groupSmis, groupTask);
+            auto mSearch = SearchMethods(1, batchSize, this->vocab["<BOS>"], this->vocab["<PAD>"], eosId, 0.0, 1, maxLength, 1, T, 1, "cpu");
+            DecodeState state;
+            this->decoderPrepare(this->encoderRun(batch)[0], this->embeddingRun(batch)[0], batch, mSearch, state);
+
+            // decoder row r holds group entry rowIdx[r], it is fed its own target token and dropped after <EOS>
+            std::vector<int64_t> rowIdx(batchSize);
+            std::iota(rowIdx.begin(), rowIdx.end(), 0);
+            std::fill(state.tokens, state.tokens + batchSize, this->vocab["<BOS>"]);
+            while (!rowIdx.empty()){
+                this->decoderForward(state);
+                const int64_t queryLength = state.probShape[1];
+                const int64_t vocabSize = state.probShape[2];
+                const float *logits = state.tokenProb + (queryLength - 1) * vocabSize;
+
+                state.keepIdx.clear();
+                std::vector<int64_t> nextRowIdx;
+                for (int64_t r=0; r < rowIdx.size(); r++){
+                    const auto &ids = targetIds[rowIdx[r]];
+                    const float *row = logits + r * queryLength * vocabSize;
+                    res[group[rowIdx[r]]] += row[ids[state.curStep]] / T - rowLogSumExp(row, vocabSize, T);
+                    if (state.curStep + 1 < ids.size()){
+                        state.keepIdx.push_back(r);
+                        nextRowIdx.push_back(rowIdx[r]);
+                    }
+                }
+                state.curStep++;
+                if (nextRowIdx.empty()) break;
+                state.keepRows(state.keepIdx);
+                rowIdx.swap(nextRowIdx);
+                for (int64_t r=0; r < rowIdx.size(); r++) state.tokens[r] = targetIds[rowIdx[r]][state.curStep - 1];
             }
-            else {mSearch.generate(outputs[0]);}
-            if (mSearch.isDone()){break;}
-            
-            delete []msaCache;
-            auto unfinishIdx = mSearch.unfinishIndex();
-            msaShape = outputs[1].GetTensorTypeAndShapeInfo().GetShape();
-            msaCache = indexSelect(outputs[1].GetTensorData<float>(), msaShape, unfinishIdx, 1, false);
-            mcaCache = indexSelect(mcaCache, mcaShape, unfinishIdx, 0);
-            taskCount = indexSelect(taskCount, taskCountShape, unfinishIdx, 0);
-            numList = constBinCount(taskCount, taskCountShape[0], {0, 1});
-            contextMask = indexSelect(contextMask, maskShape, unfinishIdx, 0);
         }
-
-        delete []msaCache;
-        delete []mcaCache;
-        delete []taskCount;
-        delete []contextMask;
-        return mSearch.finalize(this->rvocab);
+        return res;
     }
 
     std::tuple<std::vector<str>, std::vector<float>> SeqAGraphInfer::inferRun(
@@ -0,0 +1,139 @@
+#include <Inference/model_utils.h>
+
+namespace Inference {
+    InferService::InferService(std::shared_ptr<SeqAGraphInfer> model, const int64_t maxBatch, const int64_t deadlineUs, const int64_t queueSize)
+    : maxBatch(maxBatch), deadlineUs(deadlineUs), model(model), requests(queueSize), running(true){
+        this->dispatcher = std::thread(&InferService::dispatch, this);
+    }
+
+    InferService::~InferService(){this->stop();}
+
+    void InferService::stop(){
+        if (!this->running.exchange(false)) return;
+        {std::lock_guard<std::mutex> lock(this->wakeLock);}
+        this->wakeUp.notify_all();
+        if (this->dispatcher.joinable()) this->dispatcher.join();
+    }
+
+    std::future<inferResult> InferService::submit(
+        const str &smi, const int64_t task, const int64_t beamSize,
+        const float lengthPenalty, const int64_t maxLength, const float T, const int64_t returnNum
+    ){
+        auto req = new inferRequest{smi, task, beamSize, maxLength, returnNum, lengthPenalty, T, std::chrono::steady_clock::now()};
+        auto res = req->result.get_future();
+        this->submitting++;
+        if (!this->running.load()){
+            this->submitting--;
+            req->result.set_exception(std::make_exception_ptr(std::runtime_error("InferService already stopped")));
+            delete req;
+            return res;
+        }
+        while (!this->requests.tryPush(req)){std::this_thread::yield();}
+        this->submitting--;
+
+        // the lock only orders the push against the dispatcher going to sleep
+        {std::lock_guard<std::mutex> lock(this->wakeLock);}
+        this->wakeUp.notify_one();
+        return res;
+    }
+
+    void InferService::dispatch(){
+        auto sameParam = [](const inferRequest *a, const inferRequest *b){
+            return a->beamSize == b->beamSize && a->maxLength == b->maxLength && a->returnNum == b->returnNum && a->lengthPenalty == b->lengthPenalty && a->T == b->T;
+        };
+        auto hasWork = [this](){return this->requests.size() > 0 || !this->running.load();};
+
+        // requests popped while filling a micro-batch with other decode parameters
+        std::deque<inferRequest*> deferred;
+        while (true){
+            inferRequest *first = nullptr;
+            if (deferred.size()){
+                first = deferred.front();
+                deferred.pop_front();
+            }
+            else if (!this->requests.tryPop(first)){
+                if (!this->running.load() && !this->requests.size()) break;
+                std::unique_lock<std::mutex> lock(this->wakeLock);
+                this->wakeUp.wait_for(lock, std::chrono::microseconds(this->deadlineUs), hasWork);
+                continue;
+            }
+
+            std::vector<inferRequest*> batch = {first};
+            for (auto it=deferred.begin(); it != deferred.end() && batch.size() < this->maxBatch;){
+                if (sameParam(first, *it)){
+                    batch.push_back(*it);
+                    it = deferred.erase(it);
+                }
+                else it++;
+            }
+
+            auto deadline = first->enqueueTime + std::chrono::microseconds(this->deadlineUs);
+            while (batch.size() < this->maxBatch){
+                inferRequest *next = nullptr;
+                if (this->requests.tryPop(next)){
+                    if (sameParam(first, next)) batch.push_back(next);
+                    else deferred.push_back(next);
+                    continue;
+                }
+                if (!this->running.load() || std::chrono::steady_clock::now() >= deadline) break;
+                std::unique_lock<std::mutex> lock(this->wakeLock);
+                this->wakeUp.wait_until(lock, deadline, hasWork);
+            }
+            this->runBatch(batch);
+        }
+
+        // a submit that passed the running check before stop() may push after the loop has seen an empty queue,
+        // leftovers are failed until no such submit is in flight, draining meanwhile so a full queue can not block it
+        auto dropLeft = [this](){
+            inferRequest *left = nullptr;
+            while (this->requests.tryPop(left)){
+                left->result.set_exception(std::make_exception_ptr(std::runtime_error("InferService already stopped")));
+                delete left;
+            }
+        };
+        while (this->submitting.load()){
+            dropLeft();
+            std::this_thread::yield();
+        }
+        dropLeft();
+    }
+
+    void InferService::runBatch(std::vector<inferRequest*> &batch){
+        const auto param = batch[0];
+        std::vector<str> smis;
+        std::vector<int64_t> lTask;
+        for (auto req : batch){
+            smis.push_back(req->smi);
+            lTask.push_back(req->task);
+        }
+
+        auto computeBegin = std::chrono::steady_clock::now();
+        std::vector<str> inferRes;
+        std::vector<float> inferScore;
+        try {
+            std::tie(inferRes, inferScore) = this->model->plannedInferRun(
+                smis, lTask, param->beamSize, param->lengthPenalty, 1, param->maxLength, 1, param->T, param->returnNum
+            );
+        }
+        catch (...){
+            for (auto req : batch){
+                req->result.set_exception(std::current_exception());
+                delete req;
+            }
+            return;
+        }
+        auto computeEnd = std::chrono::steady_clock::now();
+        double computeUs = std::chrono::duration_cast<std::chrono::nanoseconds>(computeEnd - computeBegin).count() * 1e-3;
+
+        const int64_t returnNum = param->returnNum;
+        for (int64_t i=0; i < batch.size(); i++){
+            inferResult res;
+            res.smis = std::vector<str>(inferRes.begin() + i * returnNum, inferRes.begin() + (i + 1) * returnNum);
+            res.scores = std::vector<float>(inferScore.begin() + i * returnNum, inferScore.begin() + (i + 1) * returnNum);
+            res.queueUs = std::chrono::duration_cast<std::chrono::nanoseconds>(computeBegin - batch[i]->enqueueTime).count() * 1e-3;
+            res.computeUs = computeUs;
+            batch[i]->result.set_value(std::move(res));
+            delete batch[i];
+        }
+    }
+}
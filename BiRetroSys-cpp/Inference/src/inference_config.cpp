@@ -0,0 +1,122 @@
+#include <Inference/model_utils.h>
+
+namespace Inference {
+    InferenceConfig InferenceConfig::fromProfile(const str &name){
+        InferenceConfig config;
+        const int cores = std::max(1u, std::thread::hardware_concurrency());
+        if (name == "latency"){
+            config.intraOpThreads = cores;
+            config.interOpThreads = 1;
+            config.parallelExecution = false;
+        }
+        else if (name == "throughput"){
+            config.intraOpThreads = std::max(1, cores / 2);
+            config.interOpThreads = 2;
+            config.parallelExecution = true;
+        }
+        else if (name != "default"){
+            std::cout << "Unknown inference profile \"" + name + "\", ORT defaults are used !" << std::endl;
+            return config;
+        }
+        config.profile = name;
+        return config;
+    }
+
+    InferenceConfig InferenceConfig::load(const str &path){
+        const char *envProfile = std::getenv("BIRETRO_PROFILE");
+        InferenceConfig config = InferenceConfig::fromProfile(envProfile ? envProfile : "default");
+
+        auto trim = [](const str &s){
+            auto start = s.find_first_not_of(" \t\r");
+            auto end = s.find_last_not_of(" \t\r");
+            return start == str::npos ? str() : s.substr(start, end - start + 1);
+        };
+        const char *envPath = std::getenv("BIRETRO_CONFIG");
+        const str configPath = path.size() ? path : (envPath ? envPath : "");
+        if (configPath.size()){
+            std::ifstream fin(configPath);
+            if (!fin.is_open()) std::cout << "Inference config \"" + configPath + "\" can not be opened !" << std::endl;
+            str line;
+            while (std::getline(fin, line)){
+                line = line.substr(0, line.find('#'));
+                auto pos = line.find('=');
+                if (pos == str::npos) continue;
+                str key = trim(line.substr(0, pos)), value = trim(line.substr(pos + 1));
+                // a profile resets every field, so it is applied before the keys that follow it
+                if (key == "profile") config = InferenceConfig::fromProfile(value);
+                else if (!config.set(key, value)) std::cout << "Inference config: ignored \"" + line + "\"" << std::endl;
+            }
+        }
+
+        for (const str key : {"intra_op_threads", "inter_op_threads", "execution_mode", "graph_optimization", "cpu_mem_arena", "mem_pattern", "optimized_cache", "cache_dir", "warm_up", "thread_budget", "global_thread_pool", "native_value"}){
+            str envKey = "BIRETRO_" + key;
+            std::transform(envKey.begin(), envKey.end(), envKey.begin(), ::toupper);
+            const char *value = std::getenv(envKey.c_str());
+            if (value && !config.set(key, value)) std::cout << "Inference config: ignored " + envKey + "=" + value << std::endl;
+        }
+        return config;
+    }
+
+    bool InferenceConfig::set(const str &key, const str &value){
+        auto toInt = [&value](int &res){
+            char *end = nullptr;
+            long num = std::strtol(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || num < 0) return false;
+            res = num;
+            return true;
+        };
+        auto toBool = [&value](bool &res){
+            if (value == "1" || value == "true" || value == "on"){res = true; return true;}
+            if (value == "0" || value == "false" || value == "off"){res = false; return true;}
+            return false;
+        };
+
+        if (key == "intra_op_threads") return toInt(this->intraOpThreads);
+        if (key == "inter_op_threads") return toInt(this->interOpThreads);
+        if (key == "cpu_mem_arena") return toBool(this->cpuMemArena);
+        if (key == "mem_pattern") return toBool(this->memPattern);
+        if (key == "optimized_cache") return toBool(this->optimizedCache);
+        if (key == "warm_up") return toBool(this->warmUp);
+        if (key == "thread_budget") return toInt(this->threadBudget);
+        if (key == "global_thread_pool") return toBool(this->globalThreadPool);
+        if (key == "native_value") return toBool(this->nativeValue);
+        if (key == "cache_dir"){
+            this->cacheDir = value;
+            return true;
+        }
+        if (key == "execution_mode"){
+            if (value != "sequential" && value != "parallel") return false;
+            this->parallelExecution = value == "parallel";
+            return true;
+        }
+        if (key == "graph_optimization"){
+            const std::map<str, GraphOptimizationLevel> levels = {{"disable", ORT_DISABLE_ALL}, {"basic", ORT_ENABLE_BASIC}, {"extended", ORT_ENABLE_EXTENDED}, {"all", ORT_ENABLE_ALL}};
+            auto findRes = levels.find(value);
+            if (findRes == levels.end()) return false;
+            this->graphOptimization = findRes->second;
+            return true;
+        }
+        return false;
+    }
+
+    void InferenceConfig::apply(Ort::SessionOptions &option) const {
+        if (this->intraOpThreads > 0) option.SetIntraOpNumThreads(this->intraOpThreads);
+        if (this->interOpThreads > 0) option.SetInterOpNumThreads(this->interOpThreads);
+        option.SetExecutionMode(this->parallelExecution ? ExecutionMode::ORT_PARALLEL : ExecutionMode::ORT_SEQUENTIAL);
+        option.SetGraphOptimizationLevel(this->graphOptimization);
+        if (this->cpuMemArena) option.EnableCpuMemArena();
+        else option.DisableCpuMemArena();
+        if (this->memPattern) option.EnableMemPattern();
+        else option.DisableMemPattern();
+    }
+
+    str InferenceConfig::describe() const {
+        const std::map<GraphOptimizationLevel, str> levels = {{ORT_DISABLE_ALL, "disable"}, {ORT_ENABLE_BASIC, "basic"}, {ORT_ENABLE_EXTENDED, "extended"}, {ORT_ENABLE_ALL, "all"}};
+        return "profile=" + this->profile + " intra_op_threads=" + std::to_string(this->intraOpThreads) + " inter_op_threads=" + std::to_string(this->interOpThreads)
+            + " execution_mode=" + (this->parallelExecution ? "parallel" : "sequential") + " graph_optimization=" + levels.at(this->graphOptimization)
+            + " cpu_mem_arena=" + std::to_string(this->cpuMemArena) + " mem_pattern=" + std::to_string(this->memPattern)
+            + " optimized_cache=" + std::to_string(this->optimizedCache) + " cache_dir=" + this->cacheDir + " warm_up=" + std::to_string(this->warmUp)
+            + " thread_budget=" + std::to_string(this->threadBudget) + " global_thread_pool=" + std::to_string(this->globalThreadPool)
+            + " native_value=" + std::to_string(this->nativeValue);
+    }
+}
@@ -0,0 +1,192 @@
+#include <Inference/model_utils.h>
+
+namespace Inference {
+    MappedModel::MappedModel(const str &path){
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0){
+            void *res = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (res != MAP_FAILED){
+                this->addr = res;
+                this->length = fileStat.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    MappedModel::~MappedModel(){
+        if (this->addr) munmap(this->addr, this->length);
+    }
+
+    const void *MappedModel::data() const {return this->addr;}
+
+    size_t MappedModel::size() const {return this->length;}
+
+    uint64_t MappedModel::hash() const {
+        const unsigned char *bytes = static_cast<const unsigned char*>(this->addr);
+        uint64_t res = 14695981039346656037ULL;
+        size_t i = 0;
+        // each word goes through the splitmix64 finalizer first, so every byte of it reaches every bit of the hash
+        auto mix = [](uint64_t x){
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+            return x ^ (x >> 31);
+        };
+        for (; i + 8 <= this->length; i += 8){
+            uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            res = (res ^ mix(word)) * 1099511628211ULL;
+        }
+        for (; i < this->length; i++) res = (res ^ bytes[i]) * 1099511628211ULL;
+        return res ^ this->length;
+    }
+
+    ModelRegistry::ModelRegistry(): sessionConfig(InferenceConfig::load()), globalThreads(sessionConfig.globalThreadPool), ortEnv(createEnv(sessionConfig)){}
+
+    Ort::Env ModelRegistry::createEnv(const InferenceConfig &config){
+        auto &budget = MolHandler::threadBudget::instance();
+        budget.setBudget(config.threadBudget);
+        if (!config.globalThreadPool) return Ort::Env(ORT_LOGGING_LEVEL_WARNING, "BiRetroSys");
+
+        Ort::ThreadingOptions threading;
+        // the pool serves every concurrent Run, so it takes the whole budget, a per-call intra_op_threads would cap the process
+        threading.SetGlobalIntraOpNumThreads(budget.budget());
+        threading.SetGlobalInterOpNumThreads(config.interOpThreads > 0 ? config.interOpThreads : 1);
+        return Ort::Env(threading, ORT_LOGGING_LEVEL_WARNING, "BiRetroSys");
+    }
+
+    ModelRegistry &ModelRegistry::instance(){
+        static ModelRegistry registry;
+        return registry;
+    }
+
+    Ort::Env &ModelRegistry::env(){return this->ortEnv;}
+
+    InferenceConfig ModelRegistry::config(){
+        std::lock_guard<std::recursive_mutex> lock(this->registryLock);
+        return this->sessionConfig;
+    }
+
+    void ModelRegistry::setConfig(const InferenceConfig &newConfig){
+        std::lock_guard<std::recursive_mutex> lock(this->registryLock);
+        this->sessionConfig = newConfig;
+        MolHandler::threadBudget::instance().setBudget(newConfig.threadBudget);
+        this->deviceOptions.clear();
+        // sessions are keyed without their options, so free ones are dropped here and rebuilt on the next acquire
+        this->releaseUnused();
+    }
+
+    Ort::SessionOptions &ModelRegistry::sessionOption(const str &device){
+        auto findRes = this->deviceOptions.find(device);
+        if (findRes != this->deviceOptions.end()) return findRes->second;
+
+        Ort::SessionOptions option;
+        this->sessionConfig.apply(option);
+        // the per-session thread counts are ignored once the session runs on the global pools
+        if (this->globalThreads && this->sessionConfig.globalThreadPool) option.DisablePerSessionThreads();
+        if (device == "cuda"){
+            OrtCUDAProviderOptions cudaOption;
+            cudaOption.device_id = 0;
+            option.AppendExecutionProvider_CUDA(cudaOption);
+        }
+        return this->deviceOptions.emplace(device, std::move(option)).first->second;
+    }
+
+    std::shared_ptr<Ort::Session> ModelRegistry::acquireSession(const str &modelDir, const str &device){
+        std::lock_guard<std::recursive_mutex> lock(this->registryLock);
+        const str key = device + "|" + modelDir;
+        auto findRes = this->sessions.find(key);
+        if (findRes != this->sessions.end()) return findRes->second;
+
+        auto &option = this->sessionOption(device);
+        MappedModel model(modelDir);
+        std::shared_ptr<Ort::Session> session;
+        if (!model.size()){
+            // let ORT report the missing or unreadable file
+            session = std::make_shared<Ort::Session>(this->ortEnv, modelDir.c_str(), option, this->prepackedWeights);
+        }
+        else if (device != "cpu" || !this->sessionConfig.optimizedCache){
+            session = std::make_shared<Ort::Session>(this->ortEnv, model.data(), model.size(), option, this->prepackedWeights);
+        }
+        else {
+            const str cachePath = this->optimizedPath(modelDir, model.hash(), model.size(), device);
+            MappedModel cached(cachePath);
+            if (cached.size()){
+                // the portable passes are already applied, the configured level only adds the layout passes of this cpu
+                session = std::make_shared<Ort::Session>(this->ortEnv, cached.data(), cached.size(), option, this->prepackedWeights);
+            }
+            else {
+                // written under a private name and renamed, so concurrent processes never read a partial file.
+                // a cache directory that can not be written, e.g. a read-only install, only costs the cache
+                std::error_code ec;
+                const auto cacheDir = std::filesystem::path(cachePath).parent_path();
+                std::filesystem::create_directories(cacheDir, ec);
+                if (!ec && access(cacheDir.c_str(), W_OK) == 0){
+                    const str tempPath = cachePath + ".tmp" + std::to_string(getpid());
+                    // "all" inserts layout transforms for the instruction set of this cpu, a cache shared with another
+                    // machine must not carry them
+                    const bool fullLevel = this->sessionConfig.graphOptimization > ORT_ENABLE_EXTENDED;
+                    Ort::SessionOptions saveOption = option.Clone();
+                    saveOption.SetOptimizedModelFilePath(tempPath.c_str());
+                    if (fullLevel) saveOption.SetGraphOptimizationLevel(ORT_ENABLE_EXTENDED);
+                    try {
+                        session = std::make_shared<Ort::Session>(this->ortEnv, model.data(), model.size(), saveOption, this->prepackedWeights);
+                        std::filesystem::rename(tempPath, cachePath, ec);
+                        // the saving session stopped at extended, the one handed out is built at the configured level
+                        if (fullLevel) session.reset();
+                        if (fullLevel && !ec){
+                            MappedModel saved(cachePath);
+                            if (saved.size()) session = std::make_shared<Ort::Session>(this->ortEnv, saved.data(), saved.size(), option, this->prepackedWeights);
+                        }
+                    }
+                    catch (const Ort::Exception &e){
+                        std::cout << "Optimized model \"" + cachePath + "\" can not be saved, loading uncached: " << e.what() << std::endl;
+                    }
+                    if (ec || !session) std::filesystem::remove(tempPath, ec);
+                }
+            }
+        }
+        if (!session) session = std::make_shared<Ort::Session>(this->ortEnv, model.data(), model.size(), option, this->prepackedWeights);
+        this->sessions.emplace(key, session);
+        return session;
+    }
+
+    str ModelRegistry::optimizedPath(const str &modelDir, const uint64_t modelHash, const size_t modelSize, const str &device){
+        std::filesystem::path modelPath(modelDir);
+        std::filesystem::path cacheDir = this->sessionConfig.cacheDir.size() ? std::filesystem::path(this->sessionConfig.cacheDir) : modelPath.parent_path() / "ortcache";
+        char hashHex[17];
+        std::snprintf(hashHex, sizeof(hashHex), "%016llx", (unsigned long long)modelHash);
+        // named by the level the file is saved at, every level above extended shares one cache
+        const int savedLevel = std::min<int>(this->sessionConfig.graphOptimization, ORT_ENABLE_EXTENDED);
+        str name = modelPath.stem().string() + "-" + hashHex + "-" + std::to_string(modelSize) + "-ort" + Ort::GetVersionString() + "-" + device + "-O" + std::to_string(savedLevel) + ".onnx";
+        return (cacheDir / name).string();
+    }
+
+    std::shared_ptr<SeqAGraphInfer> ModelRegistry::acquireInfer(const modelClass &modelSelect, const str &device){
+        std::lock_guard<std::recursive_mutex> lock(this->registryLock);
+        const str key = device + "|" + std::to_string(modelSelect);
+        auto findRes = this->inferModels.find(key);
+        if (findRes != this->inferModels.end()) return findRes->second;
+
+        auto model = std::make_shared<SeqAGraphInfer>(modelSelect, device);
+        if (this->sessionConfig.warmUp) model->warmUp();
+        this->inferModels.emplace(key, model);
+        return model;
+    }
+
+    int64_t ModelRegistry::releaseUnused(){
+        std::lock_guard<std::recursive_mutex> lock(this->registryLock);
+        int64_t count = 0;
+        // models first, they hold the sessions
+        for (auto it = this->inferModels.begin(); it != this->inferModels.end();){
+            if (it->second.use_count() == 1){it = this->inferModels.erase(it); count++;}
+            else it++;
+        }
+        for (auto it = this->sessions.begin(); it != this->sessions.end();){
+            if (it->second.use_count() == 1){it = this->sessions.erase(it); count++;}
+            else it++;
+        }
+        return count;
+    }
+}
@@ -2,106 +2,153 @@
 #include <MolHandler/include_head.h>
 
 namespace MolHandler {
+    //dense lookup table built at compile time, table[key + keyOffset] is the position of key in keys or -1
+    template <size_t N, typename T, size_t M>
+    constexpr std::array<int8_t, N> denseTable(const std::array<T, M> &keys, const int keyOffset=0){
+        std::array<int8_t, N> table{};
+        for (size_t i=0; i < N; i++){table[i] = -1;}
+        for (size_t pos=0; pos < M; pos++){table[static_cast<int>(keys[pos]) + keyOffset] = pos;}
+        return table;
+    }
+
+    template <size_t N>
+    constexpr int denseGet(const std::array<int8_t, N> &table, const int key, const int udef){
+        return key >= 0 && key < int(N) && table[key] >= 0 ? table[key] : udef;
+    }
+
+    template <size_t N>
+    constexpr std::array<int, N> featOffset(const std::array<int, N> &dims){
+        std::array<int, N> offsets{};
+        int sum = 0;
+        for (size_t i=0; i < N; i++){
+            offsets[i] = sum;
+            sum += dims[i];
+        }
+        return offsets;
+    }
+
+    template <size_t N>
+    constexpr int featSize(const std::array<int, N> &dims){
+        int sum = 0;
+        for (size_t i=0; i < N; i++){sum += dims[i];}
+        return sum;
+    }
+
+    //one-hot with precomputed block offsets, negative labels are left empty
+    template <typename T1, typename T2, size_t N>
+    inline void onehotScatter(const T1 *container, T2 *resContainer, const std::array<int, N> &offsets){
+        for (size_t i=0; i < N; i++){
+            if (container[i] >= 0){resContainer[offsets[i] + container[i]] = 1;}
+        }
+    }
+
     //atom features
     constexpr int ATOMFEATNUM = 13;
 
-    const initlist<str> ATOMLIST = {"C", "N", "O", "S", "F", "Si", "P", "Cl", "Br", "Mg", "Na", "Ca", "Fe", "As", "Al", "I", "B", "V", "K", "Tl", "Yb", "Sb", "Sn", "Ag", "Pd", "Co", "Se", "Ti", "Zn", "H", "Li", "Ge", "Cu", "Au", "Ni", "Cd", "In", "Mn", "Zr", "Cr", "Pt", "Hg", "Pb", "W", "Ru", "Nb", "Re", "Te", "Rh", "Ta", "Tc", "Ba", "Bi", "Hf", "Mo", "U", "Sm", "Os", "Ir", "Ce", "Gd", "Ga", "Cs", "<unk>"};
+    constexpr std::array<std::string_view, 64> ATOMLIST = {"C", "N", "O", "S", "F", "Si", "P", "Cl", "Br", "Mg", "Na", "Ca", "Fe", "As", "Al", "I", "B", "V", "K", "Tl", "Yb", "Sb", "Sn", "Ag", "Pd", "Co", "Se", "Ti", "Zn", "H", "Li", "Ge", "Cu", "Au", "Ni", "Cd", "In", "Mn", "Zr", "Cr", "Pt", "Hg", "Pb", "W", "Ru", "Nb", "Re", "Te", "Rh", "Ta", "Tc", "Ba", "Bi", "Hf", "Mo", "U", "Sm", "Os", "Ir", "Ce", "Gd", "Ga", "Cs", "<unk>"};
 
-    constexpr initlist<RDKit::Atom::HybridizationType> HYBRIDLIST = {RDKit::Atom::HybridizationType::SP, RDKit::Atom::HybridizationType::SP2, RDKit::Atom::HybridizationType::SP3, RDKit::Atom::HybridizationType::SP3D, RDKit::Atom::HybridizationType::SP3D2};
+    //atomic numbers of ATOMLIST, "<unk>" excluded
+    constexpr std::array ATOMNUMLIST = {6, 7, 8, 16, 9, 14, 15, 17, 35, 12, 11, 20, 26, 33, 13, 53, 5, 23, 19, 81, 70, 51, 50, 47, 46, 27, 34, 22, 30, 1, 3, 32, 29, 79, 28, 48, 49, 25, 40, 24, 78, 80, 82, 74, 44, 41, 75, 52, 45, 73, 43, 56, 83, 72, 42, 92, 62, 76, 77, 58, 64, 31, 55};
 
-    constexpr initlist<RDKit::Atom::ChiralType> CHIRALIST = {RDKit::Atom::ChiralType::CHI_TETRAHEDRAL_CW, RDKit::Atom::ChiralType::CHI_TETRAHEDRAL_CCW, RDKit::Atom::ChiralType::CHI_UNSPECIFIED};
+    constexpr int UNKATOM = ATOMLIST.size() - 1;
 
-    const initlist<str> RSLIST = {"R", "S", "NONE"};
+    static_assert(ATOMNUMLIST.size() == ATOMLIST.size() - 1, "ATOMNUMLIST has to follow ATOMLIST");
 
-    constexpr initlist<int> NDEGREE = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
-    constexpr initlist<int> NCHARGE = {-1, -2, 1, 2, 0};
-    constexpr initlist<int> NVALENCE = {0, 1, 2, 3, 4, 5, 6};
-    constexpr initlist<int> NHS = {0, 1, 3, 4, 5};
+    constexpr std::array HYBRIDLIST = {RDKit::Atom::HybridizationType::SP, RDKit::Atom::HybridizationType::SP2, RDKit::Atom::HybridizationType::SP3, RDKit::Atom::HybridizationType::SP3D, RDKit::Atom::HybridizationType::SP3D2};
 
+    constexpr std::array CHIRALIST = {RDKit::Atom::ChiralType::CHI_TETRAHEDRAL_CW, RDKit::Atom::ChiralType::CHI_TETRAHEDRAL_CCW, RDKit::Atom::ChiralType::CHI_UNSPECIFIED};
 
-    template <typename T1, typename T2>
-    inline std::map<T2, int> ilist2map(const T1 &ilist){
-        std::map<T2, int> temp;
-        int i = 0;
-        for (auto elem : ilist){
-            temp.insert(std::make_pair(elem, i));
-            ++i;
-        }
-        return temp;
-    }
+    constexpr std::array<std::string_view, 3> RSLIST = {"R", "S", "NONE"};
 
-    template <typename T1, typename T2>
-    inline T2 mapGet(const std::map<T1, T2> &tgtMap, const T1 &tgt, const T2 &udef){
-        auto res = tgtMap.find(tgt);
-        T2 matchRes = res == tgtMap.end() ? udef : res->second;
-        return matchRes;
-    }
+    constexpr std::array NDEGREE = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    constexpr std::array NCHARGE = {-1, -2, 1, 2, 0};
+    constexpr std::array NVALENCE = {0, 1, 2, 3, 4, 5, 6};
+    constexpr std::array NHS = {0, 1, 3, 4, 5};
+
+    constexpr int CHARGEOFFSET = 2;
 
-    const auto atomMap = ilist2map<const initlist<str>, str>(ATOMLIST);
+    constexpr auto atomTable = denseTable<119>(ATOMNUMLIST);
 
-    const auto hybridMap = ilist2map<const initlist<RDKit::Atom::HybridizationType>, RDKit::Atom::HybridizationType>(HYBRIDLIST);
+    constexpr auto hybridTable = denseTable<32>(HYBRIDLIST);
 
-    const auto chiralMap = ilist2map<const initlist<RDKit::Atom::ChiralType>, RDKit::Atom::ChiralType>(CHIRALIST);
+    constexpr auto chiralTable = denseTable<32>(CHIRALIST);
 
-    const auto rsMap = ilist2map<const initlist<str>, str>(RSLIST);
+    constexpr auto degreeTable = denseTable<10>(NDEGREE);
 
-    const auto degreeMap = ilist2map<const initlist<int>, int>(NDEGREE);
+    constexpr auto chargeTable = denseTable<5>(NCHARGE, CHARGEOFFSET);
 
-    const auto chargeMap = ilist2map<const initlist<int>, int>(NCHARGE);
+    constexpr auto valenceTable = denseTable<7>(NVALENCE);
 
-    const auto valenceMap = ilist2map<const initlist<int>, int>(NVALENCE);
+    constexpr auto hsTable = denseTable<6>(NHS);
 
-    const auto hsMap = ilist2map<const initlist<int>, int>(NHS);
+    constexpr std::array<int, ATOMFEATNUM> ATOMFEATDIM = {int(ATOMLIST.size()), int(NDEGREE.size()), int(NCHARGE.size()), int(NVALENCE.size()), int(NHS.size()), int(CHIRALIST.size()), int(RSLIST.size()), int(HYBRIDLIST.size()), 2, 10, 2, 2, 10};
 
-    const std::vector<int> ATOMFEATDIM = {int(ATOMLIST.size()), int(NDEGREE.size()), int(NCHARGE.size()), int(NVALENCE.size()), int(NHS.size()), int(CHIRALIST.size()), int(RSLIST.size()), int(HYBRIDLIST.size()), 2, 10, 2, 2, 10};
+    constexpr auto ATOMFEATOFFSET = featOffset(ATOMFEATDIM);
+
+    constexpr int ATOMFEATSIZE = featSize(ATOMFEATDIM);
 
     template <typename T>
     inline void getAtomFeat(
         const RDKit::Atom &atom, T *container, const int lTask=0, const int lClass=-1, const int lRoot=0, const int lShuffle=0
     ){
-        auto atomSymbol = atomMap.find(atom.getSymbol());
-        if (atomSymbol == atomMap.end()){*(container) = atomMap.at("<unk>");}
+        int atomIdx = denseGet(atomTable, atom.getAtomicNum(), -1);
+        if (atomIdx < 0){*(container) = UNKATOM;}
         else {
-            *(container) = atomSymbol->second;
-            *(container + 1) = mapGet(degreeMap, int(atom.getDegree()), 9);
-            *(container + 2) = mapGet(chargeMap, atom.getFormalCharge(), 4);
-            *(container + 3) = mapGet(valenceMap, int(atom.getTotalValence()), 6);
-            *(container + 4) = mapGet(hsMap, int(atom.getTotalNumHs()), 4);
-            *(container + 5) = mapGet(chiralMap, atom.getChiralTag(), 2);
-            
-            str rsTag = "";
-            if (atom.getPropIfPresent("_CIPCode", rsTag)){*(container + 6) = mapGet(rsMap, rsTag, 2);}
-            else {*(container + 6) = 2;}
-
-            *(container + 7) = mapGet(hybridMap, atom.getHybridization(), 4);
+            *(container) = atomIdx;
+            *(container + 1) = denseGet(degreeTable, int(atom.getDegree()), 9);
+            *(container + 2) = denseGet(chargeTable, atom.getFormalCharge() + CHARGEOFFSET, 4);
+            *(container + 3) = denseGet(valenceTable, int(atom.getTotalValence()), 6);
+            *(container + 4) = denseGet(hsTable, int(atom.getTotalNumHs()), 4);
+            *(container + 5) = denseGet(chiralTable, int(atom.getChiralTag()), 2);
+
+            str rsTag;
+            *(container + 6) = 2;
+            if (atom.getPropIfPresent(RDKit::common_properties::_CIPCode, rsTag) && rsTag.size() == 1){
+                *(container + 6) = rsTag[0] == 'R' ? 0 : (rsTag[0] == 'S' ? 1 : 2);
+            }
+
+            *(container + 7) = denseGet(hybridTable, int(atom.getHybridization()), 4);
             *(container + 8) = atom.getIsAromatic();
 
-            auto tempIt = {lRoot, lShuffle, lTask, lClass};
-            std::copy(tempIt.begin(), tempIt.end(), container + 9);
+            *(container + 9) = lRoot;
+            *(container + 10) = lShuffle;
+            *(container + 11) = lTask;
+            *(container + 12) = lClass;
         }
     }
 
     //bond features
     constexpr int BONDFEATNUM = 4;
 
-    constexpr initlist<RDKit::Bond::BondType> BONDLIST = {RDKit::Bond::BondType::SINGLE, RDKit::Bond::BondType::DOUBLE, RDKit::Bond::BondType::TRIPLE, RDKit::Bond::BondType::AROMATIC};
+    constexpr std::array BONDLIST = {RDKit::Bond::BondType::SINGLE, RDKit::Bond::BondType::DOUBLE, RDKit::Bond::BondType::TRIPLE, RDKit::Bond::BondType::AROMATIC};
+
+    constexpr std::array STEREOLIST = {RDKit::Bond::BondStereo::STEREONONE, RDKit::Bond::BondStereo::STEREOE, RDKit::Bond::BondStereo::STEREOZ};
 
-    constexpr initlist<RDKit::Bond::BondStereo> STEREOLIST = {RDKit::Bond::BondStereo::STEREONONE, RDKit::Bond::BondStereo::STEREOE, RDKit::Bond::BondStereo::STEREOZ};
+    constexpr auto bondTable = denseTable<32>(BONDLIST);
 
-    const auto bondMap = ilist2map<const initlist<RDKit::Bond::BondType>, RDKit::Bond::BondType>(BONDLIST);
+    constexpr auto stereoTable = denseTable<32>(STEREOLIST);
 
-    const auto stereoMap = ilist2map<const initlist<RDKit::Bond::BondStereo>, RDKit::Bond::BondStereo>(STEREOLIST);
+    constexpr std::array<int, BONDFEATNUM> BONDFEATDIM = {int(BONDLIST.size()), int(STEREOLIST.size()), 2, 2};
 
-    const std::vector<int> BONDFEATDIM = {int(BONDLIST.size()), int(STEREOLIST.size()), 2, 2};
+    constexpr auto BONDFEATOFFSET = featOffset(BONDFEATDIM);
+
+    constexpr int BONDFEATSIZE = featSize(BONDFEATDIM);
 
     template <typename T>
     inline void getBondFeat(const RDKit::Bond &bond, const RDKit::RingInfo &ringInfo, T *container){
-        auto bondType = bondMap.find(bond.getBondType());
-        if (bondType != bondMap.end()){
-            *(container) = bondType->second;
-            *(container + 1) = mapGet(stereoMap, bond.getStereo(), 0);
+        int bondIdx = denseGet(bondTable, int(bond.getBondType()), -1);
+        if (bondIdx >= 0){
+            *(container) = bondIdx;
+            *(container + 1) = denseGet(stereoTable, int(bond.getStereo()), 0);
             *(container + 2) = bond.getIsConjugated();
             *(container + 3) = bool(ringInfo.numBondRings(bond.getIdx()));
         }
     }
-}
\ No newline at end of file
+
+    template <typename T1, typename T2>
+    inline T2 mapGet(const std::map<T1, T2> &tgtMap, const T1 &tgt, const T2 &udef){
+        auto res = tgtMap.find(tgt);
+        T2 matchRes = res == tgtMap.end() ? udef : res->second;
+        return matchRes;
+    }
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <MolHandler/include_head.h>
+#include <MolHandler/thread_budget.h>
 
 #define MATRXOPERATOR(NAME)\
     inline MatRX<NAME> operator +(const MatRX<NAME> &mat, const NAME &scalar){\
@@ -33,9 +34,31 @@ namespace MolHandler {
     constexpr int MAXK = 4;
     constexpr int MAXDEG = 9;
     constexpr int MAXPATH = 15;
+    constexpr int64_t GRAPHCACHEBYTES = int64_t(256) << 20;
     const std::vector<std::vector<int64_t>> DISTBLOCK = {{0}, {1}, {2}, {3}, {4}, {5}, {6}, {7}, {8, 15}, {15, 2048}};
 
-    const std::regex SMIREGEX(R"(\[[^\]]+\]|Br?|Cl?|N|O|S|P|F|I|b|c|n|o|s|p|\(|\)|\.|=|#|-|\+|\\|\/|:|~|@|\?|>|\*|\$|\%[0-9]{2}|[0-9])");
+    //SMILES tokens, same as matching \[[^\]]+\]|Br?|Cl?|N|O|S|P|F|I|b|c|n|o|s|p|\(|\)|\.|=|#|-|\+|\\|\/|:|~|@|\?|>|\*|\$|\%[0-9]{2}|[0-9]
+    //repeatedly, characters outside any token are skipped. tokens are views into smi
+    void tokenizeSmiles(std::string_view smi, std::vector<std::string_view> &tokens);
+
+    //token -> id through a perfect hash built once from the vocabulary, id -> token through a dense array
+    class tokenTable{
+        public:
+        tokenTable() = default;
+        tokenTable(const std::map<str, int64_t> &vocab);
+
+        int64_t find(std::string_view token, const int64_t missing=-1) const;
+        std::string_view token(const int64_t id) const;
+        int64_t size() const;
+
+        private:
+        std::vector<str> tokens;
+        std::vector<int32_t> slots;
+        uint64_t seed = 0;
+        uint64_t mask = 0;
+
+        uint64_t hash(std::string_view token, const uint64_t hashSeed) const;
+    };
 
     struct inputData{
         MatRX<float> atomFeat;
@@ -61,6 +84,62 @@ namespace MolHandler {
         }
     };
 
+    //features of one molecule before batching, bondIdx[0] is the 1-hop bond index and bondIdx[i] the (i+1)-hop index
+    struct molGraph{
+        int64_t atomNum = 0;
+        MatRX<float> atomFeat;
+        MatRX<float> bondFeat;
+        MatRX<int64_t> deg;
+        MatRX<int64_t> dist;
+        std::vector<MatRX<int64_t>> bondIdx;
+        std::vector<MatRX<int64_t>> kBondFeat;
+    };
+
+    //bounded LRU of featurized molecules keyed by "<lTask>:<canonical SMILES>", hits share the cached graph without a copy.
+    //every call takes the lock, a budget of 0 disables the cache
+    class graphCache{
+        public:
+        graphCache(const int64_t byteBudget=GRAPHCACHEBYTES);
+
+        //countMiss=false for speculative lookups that are retried under another key
+        std::shared_ptr<const molGraph> find(const str &key, const bool countMiss=true);
+        void insert(const str &key, const std::shared_ptr<const molGraph> &graph);
+        void setBudget(const int64_t byteBudget);
+        void clear();
+
+        int64_t size();
+        int64_t bytes();
+        int64_t hits();
+        int64_t misses();
+        int64_t evictions();
+        double hitRate();
+
+        //bytes held by the tensors of one graph
+        static int64_t graphBytes(const molGraph &graph);
+
+        graphCache(const graphCache &) = delete;
+        graphCache &operator=(const graphCache &) = delete;
+
+        private:
+        struct entry{
+            str key;
+            std::shared_ptr<const molGraph> graph;
+            int64_t bytes;
+        };
+
+        //drop least recently used entries until the budget holds, the lock is held by the caller
+        void evict();
+
+        std::mutex cacheLock;
+        std::list<entry> lru;
+        std::unordered_map<str, std::list<entry>::iterator> index;
+        int64_t budget;
+        int64_t used = 0;
+        int64_t hitCount = 0;
+        int64_t missCount = 0;
+        int64_t evictCount = 0;
+    };
+
     inline int64_t getDist(const int64_t dist){
         int64_t start, end, res;
         int64_t id = 0;
@@ -76,8 +155,26 @@ namespace MolHandler {
         return res;
     }
 
-    template <typename T1, typename T2>
-    inline void onehotConvert(T1 *container, T2 *resContainer, std::vector<int> dimList){
+    //block starts of DISTBLOCK, the last one opens the id of longer distances
+    constexpr std::array<int64_t, 11> DISTEDGE = {0, 1, 2, 3, 4, 5, 6, 7, 8, 15, 2048};
+
+    //getDist of every distance up to the last block start, built at compile time: a distance takes the id of the last edge not above it
+    template <size_t N, size_t M>
+    constexpr std::array<uint8_t, N> distTable(const std::array<int64_t, M> &edges){
+        std::array<uint8_t, N> table{};
+        for (size_t dist=0, id=0; dist < N; dist++){
+            while (id + 1 < M && edges[id + 1] <= int64_t(dist)){id++;}
+            table[dist] = id;
+        }
+        return table;
+    }
+
+    //longer and unreachable pairs take the last entry
+    constexpr auto DISTLUT = distTable<DISTEDGE.back() + 1>(DISTEDGE);
+    static_assert(DISTLUT[7] == 7 && DISTLUT[14] == 8 && DISTLUT[15] == 9 && DISTLUT[2047] == 9 && DISTLUT.back() == DISTEDGE.size() - 1);
+
+    template <typename T1, typename T2, typename TDim>
+    inline void onehotConvert(T1 *container, T2 *resContainer, const TDim &dimList){
         T1 val;
         for (int ptr=0, resPtr=0; ptr < dimList.size(); resPtr += dimList[ptr], ptr++){
             val = *(container + ptr);
@@ -145,6 +242,8 @@ namespace MolHandler {
         const int64_t maxPath;
 
         std::map<str, int64_t> vocab;
+        tokenTable vocabTable;
+        graphCache cache;
         molPreprocess(const int64_t maxDeg=MAXDEG, const int64_t maxK=MAXK, const int64_t maxPath=MAXPATH);
 
         molPreprocess(const str &vdir, const int64_t maxDeg=MAXDEG, const int64_t maxK=MAXK, const int64_t maxPath=MAXPATH);
@@ -155,6 +254,9 @@ namespace MolHandler {
             const std::initializer_list<str> &extraToken = {"<BOS>", "<EOS>", "<PAD>", "<UNK>"}
         );
 
+        //Replace vocab and rebuild vocabTable
+        void setVocabulary(const std::map<str, int64_t> &newVocab);
+
         //Generate canonicalize SMILES
         std::tuple<str, bool> canonicalizeSmiles(const str &smi, const bool heavyAtomCheck=false);
 
@@ -168,6 +270,25 @@ namespace MolHandler {
             const int lTask=0, const int lClass=0, const int lRoot=0, const int lShuffle=0
         );
 
+        //Parse and sanitize smi once, the molecule is owned by the caller
+        std::unique_ptr<RDKit::ROMol> parseMol(const str &smi);
+
+        //copy of mol without atom map numbers, renumbered into the atom order of its canonical SMILES (written to canoSmi).
+        //molecules with tetrahedral centers are parsed again from canoSmi, so their chiral tags match the string path
+        std::unique_ptr<RDKit::ROMol> canonicalMol(const RDKit::ROMol &mol, str &canoSmi);
+
+        //all features of one molecule, local atom indices
+        molGraph getMolGraph(const str &smi, const int lTask=0, const int lClass=0, const int lRoot=0, const int lShuffle=0);
+
+        //all features of an already sanitized molecule, in its own atom order
+        molGraph getMolGraph(const RDKit::ROMol &mol, const int lTask=0, const int lClass=0, const int lRoot=0, const int lShuffle=0);
+
+        //atom / bond one-hot features with directed bonds already sorted by (src, dst) in CSR order
+        void buildGraph(
+            const RDKit::ROMol &mol, MatRX<float> &atomFeat, MatRX<float> &bondFeat, MatRX<int64_t> &bondIdx,
+            const int lTask=0, const int lClass=0, const int lRoot=0, const int lShuffle=0
+        );
+
         //generate Q, K, V Index in global attention
         void getQKVIndex(
             MatRX<int64_t> &qIdx, MatRX<int64_t> &kvIdx,
@@ -190,10 +311,36 @@ namespace MolHandler {
             bool needBos=false, std::map<str, int64_t> *vocab=nullptr
         );
 
-        //Generate a complete batch
+        //Generate a complete batch, molecules are featurized on OpenMP threads leased from threadBudget, at most numThreads (0 for one per molecule)
         inputData generateBatch(
             const std::vector<str> &smis, const std::vector<int64_t> &lTasks,
-            const bool needSeq=false
+            const bool needSeq=false, const int numThreads=0
+        );
+
+        //Generate a complete batch into inData, buffers whose size does not change are reused.
+        //graphs are looked up in cache under the raw string first and under the canonical SMILES after canonicalization
+        void generateBatch(
+            const std::vector<str> &smis, const std::vector<int64_t> &lTasks,
+            inputData &inData, const bool needSeq=false, const int numThreads=0
+        );
+
+        //Generate a complete batch from pre-parsed sanitized molecules, features match the SMILES path: every molecule
+        //goes through canonicalMol first, only molecules with tetrahedral centers are parsed again
+        void generateBatch(
+            const std::vector<const RDKit::ROMol*> &mols, const std::vector<int64_t> &lTasks,
+            inputData &inData, const bool needSeq=false, const int numThreads=0
+        );
+
+        //second pass of generateBatch, writes every molecule's slice of the batch buffers
+        void assembleBatch(
+            const std::vector<std::shared_ptr<const molGraph>> &graphs, std::vector<MatRX<int64_t>> &unpadSeq, const std::vector<int64_t> &lTasks,
+            inputData &inData, const bool needSeq, const int threads
+        );
+
+        //degree, bucketed distance and k-hop features from one BFS per atom
+        void getTopoFeat(
+            const RDKit::ROMol &mol, MatRX<int64_t> &deg, MatRX<int64_t> &dist,
+            std::vector<MatRX<int64_t>> &kBondIdx, std::vector<MatRX<int64_t>> &kBondFeat
         );
 
         //get graph attention bias
@@ -2,8 +2,13 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <array>
 #include <initializer_list>
-#include <regex>
+#include <string_view>
 #include <chrono>
 #include <numeric>
 
@@ -15,6 +20,10 @@
 
 #include <Eigen/Core>
 
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
 using str = std::string;
 
 template<typename T>
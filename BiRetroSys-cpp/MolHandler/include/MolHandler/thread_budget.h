@@ -0,0 +1,69 @@
+#pragma once
+#include <MolHandler/include_head.h>
+#include <atomic>
+#include <thread>
+
+namespace MolHandler {
+    // process-wide thread budget. it sizes the ORT global intra-op pool (Inference::ModelRegistry), whose threads ORT
+    // schedules itself, and accounts for the project's own OpenMP loops only: a loop leases threads for its duration and
+    // leases taken at the same time split what is left, so concurrent searches run about budget() loop threads in total
+    // instead of one full team each. ORT Run calls take no lease
+    class threadBudget {
+        public:
+        static threadBudget &instance(){
+            static threadBudget budgets;
+            return budgets;
+        }
+
+        // 0 for the hardware concurrency
+        void setBudget(const int threads){
+            this->total.store(threads > 0 ? threads : int(std::max(1u, std::thread::hardware_concurrency())));
+        }
+
+        int budget() const {return this->total.load();}
+        int inUse() const {return this->used.load();}
+
+        class lease {
+            public:
+            lease(std::atomic<int> *used, const int threads): used(used), threads(threads){}
+            lease(lease &&other): used(other.used), threads(other.threads){other.used = nullptr;}
+            ~lease(){if (this->used) this->used->fetch_sub(this->threads);}
+
+            int count() const {return this->threads;}
+
+            lease(const lease &) = delete;
+            lease &operator=(const lease &) = delete;
+            lease &operator=(lease &&) = delete;
+
+            private:
+            std::atomic<int> *used;
+            int threads;
+        };
+
+        // up to want threads (0 for the whole budget), never more than are free and never less than the calling thread
+        lease acquire(const int want=0){
+            const int total = this->total.load();
+            const int cap = want > 0 ? std::min(want, total) : total;
+            int cur = this->used.load();
+            int take;
+            do {take = std::max(1, std::min(cap, total - cur));}
+            while (!this->used.compare_exchange_weak(cur, cur + take));
+            return lease(&this->used, take);
+        }
+
+        // threads for a loop over work items with at least grain items per thread, small loops stay on the calling thread
+        lease acquire(const int64_t work, const int64_t grain){
+            return this->acquire(int(std::max<int64_t>(1, std::min<int64_t>(work / std::max<int64_t>(1, grain), this->total.load()))));
+        }
+
+        threadBudget(const threadBudget &) = delete;
+        threadBudget &operator=(const threadBudget &) = delete;
+
+        private:
+        threadBudget(){this->setBudget(0);}
+
+        // setBudget may run while other threads lease
+        std::atomic<int> total{1};
+        std::atomic<int> used{0};
+    };
+}
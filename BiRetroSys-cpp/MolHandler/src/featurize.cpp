@@ -4,7 +4,189 @@
 namespace MolHandler {
     molPreprocess::molPreprocess(const int64_t maxDeg, const int64_t maxK, const int64_t maxPath): maxDeg(maxDeg), maxK(maxK), maxPath(maxPath){}
 
-    molPreprocess::molPreprocess(const str &vdir, const int64_t maxDeg, const int64_t maxK, const int64_t maxPath): maxDeg(maxDeg), maxK(maxK), maxPath(maxPath){this->vocab = this->readVocabulary(vdir);}
+    molPreprocess::molPreprocess(const str &vdir, const int64_t maxDeg, const int64_t maxK, const int64_t maxPath): maxDeg(maxDeg), maxK(maxK), maxPath(maxPath){this->setVocabulary(this->readVocabulary(vdir));}
+
+    void molPreprocess::setVocabulary(const std::map<str, int64_t> &newVocab){
+        this->vocab = newVocab;
+        this->vocabTable = tokenTable(newVocab);
+    }
+
+    graphCache::graphCache(const int64_t byteBudget): budget(byteBudget){}
+
+    std::shared_ptr<const molGraph> graphCache::find(const str &key, const bool countMiss){
+        std::lock_guard<std::mutex> lock(this->cacheLock);
+        if (this->budget <= 0) return nullptr;
+        auto findRes = this->index.find(key);
+        if (findRes == this->index.end()){
+            this->missCount += countMiss;
+            return nullptr;
+        }
+        this->hitCount++;
+        this->lru.splice(this->lru.begin(), this->lru, findRes->second);
+        return findRes->second->graph;
+    }
+
+    void graphCache::insert(const str &key, const std::shared_ptr<const molGraph> &graph){
+        const int64_t graphSize = graphCache::graphBytes(*graph) + key.size();
+        std::lock_guard<std::mutex> lock(this->cacheLock);
+        if (graphSize > this->budget) return;
+        //another thread may have featurized the same molecule meanwhile
+        if (this->index.find(key) != this->index.end()) return;
+        this->lru.push_front({key, graph, graphSize});
+        this->index[key] = this->lru.begin();
+        this->used += graphSize;
+        this->evict();
+    }
+
+    void graphCache::setBudget(const int64_t byteBudget){
+        std::lock_guard<std::mutex> lock(this->cacheLock);
+        this->budget = byteBudget;
+        this->evict();
+    }
+
+    void graphCache::clear(){
+        std::lock_guard<std::mutex> lock(this->cacheLock);
+        this->lru.clear();
+        this->index.clear();
+        this->used = 0;
+        this->hitCount = 0;
+        this->missCount = 0;
+        this->evictCount = 0;
+    }
+
+    void graphCache::evict(){
+        while (this->used > this->budget && !this->lru.empty()){
+            auto &last = this->lru.back();
+            this->used -= last.bytes;
+            this->index.erase(last.key);
+            this->lru.pop_back();
+            this->evictCount++;
+        }
+    }
+
+    int64_t graphCache::size(){
+        std::lock_guard<std::mutex> lock(this->cacheLock);
+        return this->lru.size();
+    }
+
+    int64_t graphCache::bytes(){
+        std::lock_guard<std::mutex> lock(this->cacheLock);
+        return this->used;
+    }
+
+    int64_t graphCache::hits(){
+        std::lock_guard<std::mutex> lock(this->cacheLock);
+        return this->hitCount;
+    }
+
+    int64_t graphCache::misses(){
+        std::lock_guard<std::mutex> lock(this->cacheLock);
+        return this->missCount;
+    }
+
+    int64_t graphCache::evictions(){
+        std::lock_guard<std::mutex> lock(this->cacheLock);
+        return this->evictCount;
+    }
+
+    double graphCache::hitRate(){
+        std::lock_guard<std::mutex> lock(this->cacheLock);
+        int64_t lookups = this->hitCount + this->missCount;
+        return lookups > 0 ? double(this->hitCount) / lookups : 0;
+    }
+
+    int64_t graphCache::graphBytes(const molGraph &graph){
+        int64_t res = sizeof(molGraph);
+        res += graph.atomFeat.size() * sizeof(float) + graph.bondFeat.size() * sizeof(float);
+        res += (graph.deg.size() + graph.dist.size()) * sizeof(int64_t);
+        for (const auto &idx : graph.bondIdx){res += sizeof(MatRX<int64_t>) + idx.size() * sizeof(int64_t);}
+        for (const auto &feat : graph.kBondFeat){res += sizeof(MatRX<int64_t>) + feat.size() * sizeof(int64_t);}
+        return res;
+    }
+
+    void tokenizeSmiles(std::string_view smi, std::vector<std::string_view> &tokens){
+        tokens.clear();
+        const size_t length = smi.size();
+        for (size_t pos=0; pos < length;){
+            size_t tokenLength = 0;
+            switch (smi[pos]){
+                case '[': {
+                    //at least one character before the first ']'
+                    auto close = smi.find(']', pos + 1);
+                    if (close != std::string_view::npos && close > pos + 1){tokenLength = close - pos + 1;}
+                    break;
+                }
+                case 'B': {tokenLength = pos + 1 < length && smi[pos + 1] == 'r' ? 2 : 1; break;}
+                case 'C': {tokenLength = pos + 1 < length && smi[pos + 1] == 'l' ? 2 : 1; break;}
+                case '%': {
+                    if (pos + 2 < length && std::isdigit((unsigned char)smi[pos + 1]) && std::isdigit((unsigned char)smi[pos + 2])){tokenLength = 3;}
+                    break;
+                }
+                case 'N': case 'O': case 'S': case 'P': case 'F': case 'I':
+                case 'b': case 'c': case 'n': case 'o': case 's': case 'p':
+                case '(': case ')': case '.': case '=': case '#': case '-': case '+': case '\\': case '/':
+                case ':': case '~': case '@': case '?': case '>': case '*': case '$':
+                case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9': {
+                    tokenLength = 1;
+                    break;
+                }
+                default: break;
+            }
+            if (tokenLength > 0){
+                tokens.push_back(smi.substr(pos, tokenLength));
+                pos += tokenLength;
+            }
+            else {pos++;}
+        }
+    }
+
+    tokenTable::tokenTable(const std::map<str, int64_t> &vocab){
+        int64_t maxId = -1;
+        for (const auto &[token, id] : vocab){maxId = id > maxId ? id : maxId;}
+        this->tokens.resize(maxId + 1);
+        for (const auto &[token, id] : vocab){this->tokens[id] = token;}
+
+        //smallest power of two table of at least twice the vocabulary, grown until some seed is collision free
+        uint64_t tableSize = 2;
+        while (tableSize < vocab.size() * 2){tableSize <<= 1;}
+        for (bool built=vocab.size() == 0; !built; tableSize <<= 1){
+            for (uint64_t trySeed=0; trySeed < 4096 && !built; trySeed++){
+                this->slots.assign(tableSize, -1);
+                built = true;
+                for (const auto &[token, id] : vocab){
+                    auto &slot = this->slots[this->hash(token, trySeed) & (tableSize - 1)];
+                    if (slot >= 0){built = false; break;}
+                    slot = id;
+                }
+                if (built){
+                    this->seed = trySeed;
+                    this->mask = tableSize - 1;
+                }
+            }
+            if (built) break;
+        }
+    }
+
+    uint64_t tokenTable::hash(std::string_view token, const uint64_t hashSeed) const {
+        uint64_t res = 14695981039346656037ULL ^ (hashSeed * 0x9E3779B97F4A7C15ULL);
+        for (auto c : token){
+            res ^= (unsigned char)c;
+            res *= 1099511628211ULL;
+        }
+        return res ^ (res >> 29);
+    }
+
+    int64_t tokenTable::find(std::string_view token, const int64_t missing) const {
+        if (this->slots.size() == 0) return missing;
+        auto id = this->slots[this->hash(token, this->seed) & this->mask];
+        return id >= 0 && this->tokens[id] == token ? id : missing;
+    }
+
+    std::string_view tokenTable::token(const int64_t id) const {
+        return id >= 0 && id < this->tokens.size() ? std::string_view(this->tokens[id]) : std::string_view();
+    }
+
+    int64_t tokenTable::size() const {return this->tokens.size();}
 
     //Read vocabulary from vocabulary.txt
     std::map<str, int64_t> molPreprocess::readVocabulary(
@@ -26,8 +208,8 @@ namespace MolHandler {
     }
 
     //Generate canonicalize SMILES
-    inline std::tuple<str, bool> molPreprocess::canonicalizeSmiles(const str &smi, const bool heavyAtomCheck){
-        RDKit::RWMol *mol1 = RDKit::SmilesToMol(smi, 0, false);
+    std::tuple<str, bool> molPreprocess::canonicalizeSmiles(const str &smi, const bool heavyAtomCheck){
+        std::unique_ptr<RDKit::RWMol> mol1(RDKit::SmilesToMol(smi, 0, false));
         str cano_smi = "";
         bool is_valid = true;
         try {
@@ -56,15 +238,17 @@ namespace MolHandler {
     }
 
     //Generate sequence with vocabulary
-    inline MatRX<int64_t> molPreprocess::generateSeq(const str &smi, std::map<str, int64_t> *vocab){
-        if (vocab == nullptr){vocab = &(this->vocab);}
-        std::sregex_iterator tokenIter(smi.begin(), smi.end(), SMIREGEX);
-        auto iterEnd = std::sregex_iterator();
-        MatRX<int64_t> tokens(1, std::distance(tokenIter, iterEnd));
-
-        int64_t unkId = (*vocab).find("<UNK>")->second;
-        for (int i=0; tokenIter != iterEnd; tokenIter++, i++){
-            tokens(0, i) = mapGet((*vocab), tokenIter->str(), unkId);
+    MatRX<int64_t> molPreprocess::generateSeq(const str &smi, std::map<str, int64_t> *vocab){
+        std::vector<std::string_view> tokenList;
+        tokenizeSmiles(smi, tokenList);
+        MatRX<int64_t> tokens(1, tokenList.size());
+        if (vocab == nullptr){
+            int64_t unkId = this->vocabTable.find("<UNK>");
+            for (int i=0; i < tokenList.size(); i++){tokens(0, i) = this->vocabTable.find(tokenList[i], unkId);}
+        }
+        else {
+            int64_t unkId = (*vocab).find("<UNK>")->second;
+            for (int i=0; i < tokenList.size(); i++){tokens(0, i) = mapGet((*vocab), str(tokenList[i]), unkId);}
         }
         return tokens;
     }
@@ -74,68 +258,109 @@ namespace MolHandler {
         int64_t &preCumLength, int64_t &preLength, int64_t &batchId,
         const int lTask, const int lClass, const int lRoot, const int lShuffle
     ){
-        auto mol = *(RDKit::SmilesToMol(smi));
-        auto ringInfo = *(mol.getRingInfo());
+        auto graph = this->getMolGraph(smi, lTask, lClass, lRoot, lShuffle);
+        int64_t atomNum = graph.atomNum;
+
+        //generate a batch
+        inData.atomFeat = inData.atomFeat.size() > 0 ? concat(inData.atomFeat, graph.atomFeat) : graph.atomFeat;
+        inData.deg = inData.deg.size() > 0 ? concat(inData.deg, graph.deg, -1) : graph.deg;
+        inData.dist = inData.dist.size() > 0 ? concat(inData.dist, graph.dist, -1) : graph.dist;
+        this->getQKVIndex(inData.queryIdx, inData.keyIdx, preLength, atomNum);
+        this->getBatchBond(inData.bondFeat, graph.bondFeat, inData.kBondFeat, graph.kBondFeat, inData.bondIdx, graph.bondIdx, inData.attnBondIdx, preCumLength, preLength, atomNum);
+        inData.graphLength(0, batchId) = atomNum;
+        preCumLength += (atomNum * atomNum);
+        preLength += atomNum;
+    }
+
+    //the only sanitizing parse of a molecule, failures fall back to "CC" like invalid input in generateBatch
+    std::unique_ptr<RDKit::ROMol> molPreprocess::parseMol(const str &smi){
+        std::unique_ptr<RDKit::ROMol> mol;
+        try {mol.reset(RDKit::SmilesToMol(smi));}
+        catch (const std::exception &e){mol.reset();}
+        if (mol == nullptr){
+            std::cout << "Input molecule \"" + smi + "\" can not be sanitized !" << std::endl;
+            mol.reset(RDKit::SmilesToMol("CC"));
+        }
+        return mol;
+    }
+
+    std::unique_ptr<RDKit::ROMol> molPreprocess::canonicalMol(const RDKit::ROMol &mol, str &canoSmi){
+        RDKit::RWMol copy(mol);
+        bool chiral = false;
+        for (auto atom : copy.atoms()){
+            atom->clearProp("molAtomMapNumber");
+            chiral = chiral || atom->getChiralTag() == RDKit::Atom::CHI_TETRAHEDRAL_CW || atom->getChiralTag() == RDKit::Atom::CHI_TETRAHEDRAL_CCW;
+        }
+        canoSmi = RDKit::MolToSmiles(copy);
+        //a tetrahedral tag is relative to the bond order around its atom, which only parsing the canonical SMILES reproduces
+        if (chiral) return this->parseMol(canoSmi);
+        std::vector<unsigned int> order;
+        copy.getProp(RDKit::common_properties::_smilesAtomOutputOrder, order);
+        return std::unique_ptr<RDKit::ROMol>(RDKit::MolOps::renumberAtoms(copy, order));
+    }
+
+    molGraph molPreprocess::getMolGraph(const str &smi, const int lTask, const int lClass, const int lRoot, const int lShuffle){
+        auto mol = this->parseMol(smi);
+        return this->getMolGraph(*mol, lTask, lClass, lRoot, lShuffle);
+    }
+
+    molGraph molPreprocess::getMolGraph(const RDKit::ROMol &mol, const int lTask, const int lClass, const int lRoot, const int lShuffle){
+        molGraph graph;
+        graph.atomNum = mol.getNumAtoms();
+        MatRX<int64_t> bondIdx;
+        this->buildGraph(mol, graph.atomFeat, graph.bondFeat, bondIdx, lTask, lClass, lRoot, lShuffle);
+
+        this->getTopoFeat(mol, graph.deg, graph.dist, graph.bondIdx, graph.kBondFeat);
+        graph.bondIdx.insert(graph.bondIdx.begin(), bondIdx);
+        return graph;
+    }
+
+    void molPreprocess::buildGraph(
+        const RDKit::ROMol &mol, MatRX<float> &atomFeat, MatRX<float> &bondFeat, MatRX<int64_t> &bondIdx,
+        const int lTask, const int lClass, const int lRoot, const int lShuffle
+    ){
+        const auto &ringInfo = *(mol.getRingInfo());
         int64_t atomNum = mol.getNumAtoms();
         int64_t bondNum = mol.getNumBonds();
-        MatRX<int> atomLabel = MatRX<int>::Constant(atomNum, ATOMFEATNUM, -1);
-        MatRX<int> bondLabel = MatRX<int>::Constant(bondNum * 2, BONDFEATNUM, -1);
-        MatRX<float> atomFeat = MatRX<float>::Zero(atomNum, std::accumulate(ATOMFEATDIM.begin(), ATOMFEATDIM.end(), 0));
-        MatRX<float> bondFeat = MatRX<float>::Zero(bondNum * 2, std::accumulate(BONDFEATDIM.begin(), BONDFEATDIM.end(), 0));
-        MatRX<int64_t> bondIdx(2, bondNum * 2);
-
-        int64_t start, end;
-        int rbI = 0;
+        atomFeat = MatRX<float>::Zero(atomNum, ATOMFEATSIZE);
+        bondFeat = MatRX<float>::Zero(bondNum * 2, BONDFEATSIZE);
+        bondIdx = MatRX<int64_t>(2, bondNum * 2);
+
+        int atomLabel[ATOMFEATNUM];
         for (auto atom : mol.atoms()){
-            getAtomFeat(*atom, atomLabel.row(rbI).data(), lTask, lClass, lRoot, lShuffle);
-            onehotConvert(atomLabel.row(rbI).data(), atomFeat.row(rbI).data(), ATOMFEATDIM);
-            rbI++;
+            std::fill(atomLabel, atomLabel + ATOMFEATNUM, -1);
+            getAtomFeat(*atom, atomLabel, lTask, lClass, lRoot, lShuffle);
+            onehotScatter(atomLabel, atomFeat.row(atom->getIdx()).data(), ATOMFEATOFFSET);
         }
-        rbI = 0;
+
+        // counting sort of both bond directions by source atom, then each (small) row by destination
+        std::vector<int64_t> rowStart(atomNum + 1, 0);
         for (auto bond : mol.bonds()){
-            start = bond->getBeginAtomIdx();
-            end = bond->getEndAtomIdx();
-            bondIdx(0, rbI) = start;
-            bondIdx(1, rbI) = end;
-            bondIdx(0, rbI + 1) = end;
-            bondIdx(1, rbI + 1) = start;
-            getBondFeat(*bond, ringInfo, bondLabel.row(rbI).data());
-            // std::copy(bondLabel.row(rbI).data(), bondLabel.row(rbI).data() + bondLabel.cols(), bondLabel.row(rbI + 1).data());
-            onehotConvert(bondLabel.row(rbI).data(), bondFeat.row(rbI).data(), BONDFEATDIM);
-            std::copy(bondFeat.row(rbI).data(), bondFeat.row(rbI).data() + bondFeat.cols(), bondFeat.row(rbI + 1).data());
-            rbI += 2;
+            rowStart[bond->getBeginAtomIdx() + 1]++;
+            rowStart[bond->getEndAtomIdx() + 1]++;
         }
-        //sort
-        std::vector<int64_t> sortScore(bondIdx.cols());
-        for (int i=0; i <sortScore.size(); i++){sortScore[i] = bondIdx(0, i) * atomNum + bondIdx(1, i);}
+        for (int64_t i=0; i < atomNum; i++){rowStart[i + 1] += rowStart[i];}
 
-        for (int i=0, srcCount=bondIdx.cols() - 1; i < srcCount; i++){
-            for (int j=0; j < srcCount - i; j++){
-                if (sortScore[j] > sortScore[j+1]){
-                    bondIdx.col(j).swap(bondIdx.col(j+1));
-                    bondFeat.row(j).swap(bondFeat.row(j+1));
+        std::vector<int64_t> rowFill(rowStart.begin(), rowStart.end() - 1);
+        std::vector<std::pair<int64_t, const RDKit::Bond*>> edges(bondNum * 2);
+        for (auto bond : mol.bonds()){
+            int64_t start = bond->getBeginAtomIdx();
+            int64_t end = bond->getEndAtomIdx();
+            edges[rowFill[start]++] = std::make_pair(end, bond);
+            edges[rowFill[end]++] = std::make_pair(start, bond);
+        }
 
-                    std::swap(sortScore[j], sortScore[j+1]);
-                }
+        int bondLabel[BONDFEATNUM];
+        for (int64_t src=0; src < atomNum; src++){
+            std::sort(edges.begin() + rowStart[src], edges.begin() + rowStart[src + 1], [](const auto &a, const auto &b){return a.first < b.first;});
+            for (int64_t e=rowStart[src]; e < rowStart[src + 1]; e++){
+                bondIdx(0, e) = src;
+                bondIdx(1, e) = edges[e].first;
+                std::fill(bondLabel, bondLabel + BONDFEATNUM, -1);
+                getBondFeat(*edges[e].second, ringInfo, bondLabel);
+                onehotScatter(bondLabel, bondFeat.row(e).data(), BONDFEATOFFSET);
             }
         }
-        // std::cout << atomLabel << std::endl;
-        // std::cout << "atomLen:" << atomLabel.rows() << std::endl;
-        // std::cout << bondFeat << std::endl;
-        // std::cout << "bondLen" << bondFeat.rows() << std::endl;
-        auto [degMatrix, distMatrix] = getAttentionBias(mol);
-        auto [kBondIdx, kBondFeat] = getKhopFeat(mol);
-        kBondIdx.insert(kBondIdx.begin(), bondIdx);
-
-        //generate a batch
-        inData.atomFeat = inData.atomFeat.size() > 0 ? concat(inData.atomFeat, atomFeat) : atomFeat;
-        inData.deg = inData.deg.size() > 0 ? concat(inData.deg, degMatrix, -1) : degMatrix;
-        inData.dist = inData.dist.size() > 0 ? concat(inData.dist, distMatrix, -1) : distMatrix;
-        this->getQKVIndex(inData.queryIdx, inData.keyIdx, preLength, atomNum);
-        this->getBatchBond(inData.bondFeat, bondFeat, inData.kBondFeat, kBondFeat, inData.bondIdx, kBondIdx, inData.attnBondIdx, preCumLength, preLength, atomNum);
-        inData.graphLength(0, batchId) = atomNum;
-        preCumLength += (atomNum * atomNum);
-        preLength += atomNum;
     }
 
     //generate Q, K, V Index in global attention
@@ -204,93 +429,271 @@ namespace MolHandler {
 
     inputData molPreprocess::generateBatch(
         const std::vector<str> &smis, const std::vector<int64_t> &lTasks,
-        const bool needSeq
+        const bool needSeq, const int numThreads
     ){
-        int64_t preCumLength = 0;
-        int64_t preLength = 0;
-        int64_t maxSeqLength = 0;
-        inputData inData(smis.size());
-        std::vector<MatRX<int64_t>> unpadSeq(smis.size());
-        for (int64_t batchId=0; batchId < smis.size(); batchId++){
-            auto [canoSmi, isValid] = this->canonicalizeSmiles(smis[batchId]);
-            canoSmi = isValid ? canoSmi : "CC";
-            this->generateGraph(canoSmi, inData, preCumLength, preLength, batchId, lTasks[batchId], -1);
+        inputData inData(smis.size(), this->maxK);
+        this->generateBatch(smis, lTasks, inData, needSeq, numThreads);
+        return inData;
+    }
+
+    void molPreprocess::generateBatch(
+        const std::vector<str> &smis, const std::vector<int64_t> &lTasks,
+        inputData &inData, const bool needSeq, const int numThreads
+    ){
+        const int64_t batchSize = smis.size();
+        #ifdef _OPENMP
+        auto threadLease = threadBudget::instance().acquire(numThreads > 0 ? numThreads : batchSize);
+        const int threads = threadLease.count();
+        #else
+        const int threads = 1;
+        #endif
+
+        //first pass, features of every molecule, molecules are independent.
+        //a raw string that is already canonical hits the cache without being parsed
+        std::vector<std::shared_ptr<const molGraph>> graphs(batchSize);
+        std::vector<MatRX<int64_t>> unpadSeq(batchSize);
+        #pragma omp parallel for num_threads(threads) schedule(dynamic, 1) if(threads > 1 && batchSize > 1)
+        for (int64_t batchId=0; batchId < batchSize; batchId++){
+            const str taskKey = std::to_string(lTasks[batchId]) + ":";
+            str canoSmi = smis[batchId];
+            graphs[batchId] = this->cache.find(taskKey + canoSmi, false);
+            if (graphs[batchId] == nullptr){
+                bool isValid;
+                std::tie(canoSmi, isValid) = this->canonicalizeSmiles(smis[batchId]);
+                canoSmi = isValid ? canoSmi : "CC";
+                graphs[batchId] = this->cache.find(taskKey + canoSmi);
+            }
+            if (graphs[batchId] == nullptr){
+                auto mol = this->parseMol(canoSmi);
+                auto graph = std::make_shared<const molGraph>(this->getMolGraph(*mol, lTasks[batchId], -1));
+                this->cache.insert(taskKey + canoSmi, graph);
+                graphs[batchId] = graph;
+            }
+            if (needSeq){unpadSeq[batchId] = this->generateSeq(canoSmi);}
+        }
+        this->assembleBatch(graphs, unpadSeq, lTasks, inData, needSeq, threads);
+    }
+
+    void molPreprocess::generateBatch(
+        const std::vector<const RDKit::ROMol*> &mols, const std::vector<int64_t> &lTasks,
+        inputData &inData, const bool needSeq, const int numThreads
+    ){
+        const int64_t batchSize = mols.size();
+        #ifdef _OPENMP
+        auto threadLease = threadBudget::instance().acquire(numThreads > 0 ? numThreads : batchSize);
+        const int threads = threadLease.count();
+        #else
+        const int threads = 1;
+        #endif
+
+        //atoms are renumbered into canonical SMILES order as the string path sees them, a null entry is featurized as "CC"
+        std::vector<std::shared_ptr<const molGraph>> graphs(batchSize);
+        std::vector<MatRX<int64_t>> unpadSeq(batchSize);
+        #pragma omp parallel for num_threads(threads) schedule(dynamic, 1) if(threads > 1 && batchSize > 1)
+        for (int64_t batchId=0; batchId < batchSize; batchId++){
+            std::unique_ptr<RDKit::ROMol> canonical;
+            str canoSmi = "CC";
+            if (mols[batchId] == nullptr) canonical = this->parseMol(canoSmi);
+            else canonical = this->canonicalMol(*mols[batchId], canoSmi);
+            graphs[batchId] = std::make_shared<const molGraph>(this->getMolGraph(*canonical, lTasks[batchId], -1));
+            if (needSeq){unpadSeq[batchId] = this->generateSeq(canoSmi);}
+        }
+        this->assembleBatch(graphs, unpadSeq, lTasks, inData, needSeq, threads);
+    }
+
+    void molPreprocess::assembleBatch(
+        const std::vector<std::shared_ptr<const molGraph>> &graphs, std::vector<MatRX<int64_t>> &unpadSeq, const std::vector<int64_t> &lTasks,
+        inputData &inData, const bool needSeq, const int threads
+    ){
+        const int64_t batchSize = graphs.size();
+        const int64_t maxK = this->maxK;
+        inData.lTask.resize(1, batchSize);
+        inData.lClass.resize(1, batchSize);
+        inData.graphLength.resize(1, batchSize);
+        inData.seqLength.resize(1, batchSize);
+        inData.bondSplit.resize(1, maxK);
+        inData.kBondFeat.resize(maxK - 1);
+        inData.bondIdx.resize(maxK);
+        inData.attnBondIdx.resize(maxK);
+
+        //sizes and per-molecule offsets, a k-hop block only exists once some molecule has entries for it, as with the concat path
+        int64_t atomTotal = 0, pairTotal = 0, bondTotal = 0, maxSeqLength = 0;
+        std::vector<int64_t> atomOffset(batchSize), pairOffset(batchSize), bondOffset(batchSize);
+        std::vector<int64_t> kOffset(batchSize * maxK), kFeatOffset(batchSize * (maxK - 1));
+        std::vector<int64_t> kTotal(maxK, 0), kFeatTotal(maxK - 1, 0);
+        std::vector<bool> kUsed(maxK, false);
+        for (int64_t batchId=0; batchId < batchSize; batchId++){
+            const auto &graph = *graphs[batchId];
+            atomOffset[batchId] = atomTotal;
+            pairOffset[batchId] = pairTotal;
+            bondOffset[batchId] = bondTotal;
+            atomTotal += graph.atomNum;
+            pairTotal += graph.atomNum * graph.atomNum;
+            bondTotal += graph.bondFeat.rows();
+            for (int i=0; i < maxK; i++){
+                kOffset[batchId * maxK + i] = kTotal[i];
+                if (i < maxK - 1){kFeatOffset[batchId * (maxK - 1) + i] = kFeatTotal[i];}
+                if (graph.bondIdx[i].size() == 0) continue;
+                kUsed[i] = true;
+                kTotal[i] += graph.bondIdx[i].cols();
+                if (i < maxK - 1){kFeatTotal[i] += graph.kBondFeat[i].rows();}
+            }
             if (needSeq){
-                unpadSeq[batchId] = this->generateSeq(canoSmi);
                 maxSeqLength = maxSeqLength > unpadSeq[batchId].cols() ? maxSeqLength : unpadSeq[batchId].cols();
                 inData.seqLength(0, batchId) = unpadSeq[batchId].cols();
             }
         }
+
+        //second pass, every buffer is sized once and each molecule writes its own slice
+        inData.atomFeat.resize(atomTotal, ATOMFEATSIZE);
+        inData.bondFeat.resize(bondTotal, BONDFEATSIZE);
+        inData.deg.resize(1, atomTotal);
+        inData.dist.resize(1, pairTotal);
+        inData.queryIdx.resize(1, pairTotal);
+        inData.keyIdx.resize(1, pairTotal);
+        for (int i=0; i < maxK; i++){
+            inData.bondIdx[i].resize(kUsed[i] ? 2 : 0, kTotal[i]);
+            inData.attnBondIdx[i].resize(kUsed[i] ? 1 : 0, kTotal[i]);
+            if (i < maxK - 1){inData.kBondFeat[i].resize(kFeatTotal[i], kUsed[i] ? 1 : 0);}
+        }
+
+        #pragma omp parallel for num_threads(threads) schedule(dynamic, 1) if(threads > 1 && batchSize > 1)
+        for (int64_t batchId=0; batchId < batchSize; batchId++){
+            const auto &graph = *graphs[batchId];
+            const int64_t atomNum = graph.atomNum;
+            const int64_t atomStart = atomOffset[batchId], pairStart = pairOffset[batchId];
+            inData.atomFeat.middleRows(atomStart, atomNum) = graph.atomFeat;
+            inData.bondFeat.middleRows(bondOffset[batchId], graph.bondFeat.rows()) = graph.bondFeat;
+            inData.deg.middleCols(atomStart, atomNum) = graph.deg;
+            inData.dist.middleCols(pairStart, atomNum * atomNum) = graph.dist;
+            for (int64_t i=0; i < atomNum; i++){
+                for (int64_t j=0; j < atomNum; j++){
+                    inData.queryIdx(0, pairStart + i * atomNum + j) = atomStart + i;
+                    inData.keyIdx(0, pairStart + i * atomNum + j) = atomStart + j;
+                }
+            }
+
+            for (int k=0; k < maxK; k++){
+                const auto &idx = graph.bondIdx[k];
+                if (idx.size() == 0) continue;
+                const int64_t kStart = kOffset[batchId * maxK + k];
+                for (int64_t c=0; c < idx.cols(); c++){
+                    inData.bondIdx[k](0, kStart + c) = idx(0, c) + atomStart;
+                    inData.bondIdx[k](1, kStart + c) = idx(1, c) + atomStart;
+                    inData.attnBondIdx[k](0, kStart + c) = idx(0, c) * atomNum + idx(1, c) + pairStart;
+                }
+                if (k < maxK - 1){
+                    const auto &feat = graph.kBondFeat[k];
+                    inData.kBondFeat[k].middleRows(kFeatOffset[batchId * (maxK - 1) + k], feat.rows()) = feat;
+                }
+            }
+            inData.graphLength(0, batchId) = atomNum;
+        }
+
         inData.bondSplit(0, 0) = inData.bondFeat.rows();
-        for (int i=1; i < this->maxK; i++){inData.bondSplit(0, i) = inData.kBondFeat[i-1].rows();}
+        for (int i=1; i < maxK; i++){inData.bondSplit(0, i) = inData.kBondFeat[i-1].rows();}
         if (needSeq){
             this->getPaddingSeq(unpadSeq, inData.seqFeat, inData.seqLength, maxSeqLength, true);
         }
-        // inData.lTask = Eigen::Map<MatRX<int64_t>>(lTasks.data(), 1, smis.size());
         for (int i=0; i < inData.lTask.cols(); i++){inData.lTask(0, i) = lTasks[i];}
-        inData.lClass = MatRX<int64_t>::Zero(1, smis.size());
-        return inData;
+        inData.lClass.setZero();
     }
 
-    inline std::tuple<MatRX<int64_t>, MatRX<int64_t>> molPreprocess::getAttentionBias(const RDKit::ROMol &mol){
-        int atomNum = mol.getNumAtoms();
-        auto adjMatrix = RDKit::MolOps::getAdjacencyMatrix(mol);
-        auto spdMatrix = RDKit::MolOps::getDistanceMat(mol);
-
-        MatRX<int64_t> degMatrix(1, atomNum);
-        degMatrix.fill(0);
-        MatRX<int64_t> distMatrix(1, atomNum * atomNum);
-        distMatrix.fill(-1);
-
-        for (int i=0; i < atomNum; i++){
-            for (int j=0; j < atomNum; j++){
-                degMatrix(0, i) += *(adjMatrix + i * atomNum + j);
-                distMatrix(0, i * atomNum + j) = getDist(*(spdMatrix + i * atomNum + j));
+    //one BFS from every atom over the bond list gives the shortest distance to every atom and, up to maxK,
+    //the number of shortest paths capped at maxPath. k-hop pairs are the pairs at shortest distance k
+    void molPreprocess::getTopoFeat(
+        const RDKit::ROMol &mol, MatRX<int64_t> &deg, MatRX<int64_t> &dist,
+        std::vector<MatRX<int64_t>> &kBondIdx, std::vector<MatRX<int64_t>> &kBondFeat
+    ){
+        const int64_t atomNum = mol.getNumAtoms();
+        const uint16_t unreached = UINT16_MAX;
+        std::vector<std::vector<int64_t>> kIdx(this->maxK - 1), kFeat(this->maxK - 1);
 
-            }
-            degMatrix(0, i) = degMatrix(0, i) > this->maxDeg ? maxDeg : degMatrix(0, i);
+        //neighbour lists in CSR order, the degree is the neighbour count
+        std::vector<int64_t> nbrStart(atomNum + 1, 0), nbrList(mol.getNumBonds() * 2);
+        for (auto bond : mol.bonds()){
+            nbrStart[bond->getBeginAtomIdx() + 1]++;
+            nbrStart[bond->getEndAtomIdx() + 1]++;
         }
-        return std::make_tuple(degMatrix, distMatrix);
-    }
-
-    inline std::tuple<std::vector<MatRX<int64_t>>, std::vector<MatRX<int64_t>>> molPreprocess::getKhopFeat(const RDKit::ROMol &mol){
-        int atomNum = mol.getNumAtoms();
-        std::vector<MatRX<double>> kAdjMatrix;
-        std::vector<MatRX<int64_t>> kBondIdx;
-        std::vector<MatRX<int64_t>> kBondFeat;
-
-        Eigen::Map<MatRX<double>> adjMatrix(RDKit::MolOps::getAdjacencyMatrix(mol), atomNum, atomNum);
-
-        kAdjMatrix.push_back(adjMatrix);
-        for (int i=0; i < this->maxK - 1; i++){kAdjMatrix.push_back(kAdjMatrix.back() * adjMatrix);}
-        for (auto &matrix : kAdjMatrix){
-            for (int i=0; i < atomNum; i++){matrix(i, i) = 0;}
+        deg.resize(1, atomNum);
+        for (int64_t i=0; i < atomNum; i++){
+            deg(0, i) = nbrStart[i+1] > this->maxDeg ? this->maxDeg : nbrStart[i+1];
+            nbrStart[i+1] += nbrStart[i];
         }
-        
-        auto lastPath = kAdjMatrix[0];
-        for (int i=1; i < this->maxK; i++){
-            matrixFilter(kAdjMatrix[i].data(), lastPath.data(), kAdjMatrix[i].size(), 0, [](const int &val){return val > 0;});
-            lastPath += kAdjMatrix[i];
+        std::vector<int64_t> nbrFill(nbrStart.begin(), nbrStart.end() - 1);
+        for (auto bond : mol.bonds()){
+            nbrList[nbrFill[bond->getBeginAtomIdx()]++] = bond->getEndAtomIdx();
+            nbrList[nbrFill[bond->getEndAtomIdx()]++] = bond->getBeginAtomIdx();
         }
 
-        for (int i=1; i < this->maxK; i++){
-            auto &iAdj = kAdjMatrix[i];
-            MatRX<int64_t> iBondFeat(atomNum * atomNum, 1);
-            MatRX<int64_t> iBondIdx(2, atomNum * atomNum);
-            int count=0;
-            for (int64_t row=0; row < atomNum; row++){
-                for (int64_t col=0; col < atomNum; col++){
-                    if (iAdj(row, col) > 0){
-                        iBondIdx(0, count) = row;
-                        iBondIdx(1, count) = col;
-                        iBondFeat(count, 0) = iAdj(row, col) > this->maxPath ? this->maxPath : iAdj(row, col);
-                        count++;
+        //depth and capped shortest path count of every atom reached from the current source, reset after each source
+        dist.resize(1, atomNum * atomNum);
+        std::vector<uint16_t> depth(atomNum, unreached);
+        std::vector<uint16_t> pathCount(atomNum, 0);
+        std::vector<int64_t> visited, frontier, nextFrontier;
+        for (int64_t src=0; src < atomNum; src++){
+            depth[src] = 0;
+            pathCount[src] = 1;
+            visited.assign(1, src);
+            frontier.assign(1, src);
+            for (int64_t k=1; frontier.size() > 0; k++){
+                nextFrontier.clear();
+                for (auto u : frontier){
+                    for (int64_t e=nbrStart[u]; e < nbrStart[u+1]; e++){
+                        auto v = nbrList[e];
+                        if (depth[v] == unreached){
+                            depth[v] = k < unreached ? k : unreached - 1;
+                            pathCount[v] = 0;
+                            nextFrontier.push_back(v);
+                            visited.push_back(v);
+                        }
+                        if (k <= this->maxK && depth[v] == k){
+                            pathCount[v] = std::min<int64_t>(pathCount[v] + pathCount[u], this->maxPath);
+                        }
+                    }
+                }
+                //pairs are listed by (src, dst) as in a row-major scan
+                if (k > 1 && k <= this->maxK){
+                    std::sort(nextFrontier.begin(), nextFrontier.end());
+                    for (auto v : nextFrontier){
+                        kIdx[k-2].push_back(src);
+                        kIdx[k-2].push_back(v);
+                        kFeat[k-2].push_back(pathCount[v]);
                     }
                 }
+                std::swap(frontier, nextFrontier);
+            }
+            for (int64_t v=0; v < atomNum; v++){
+                dist(0, src * atomNum + v) = depth[v] < DISTLUT.size() ? DISTLUT[depth[v]] : DISTLUT.back();
             }
-            kBondIdx.push_back(iBondIdx.leftCols(count));
-            kBondFeat.push_back(iBondFeat.topRows(count));
+            for (auto v : visited){depth[v] = unreached;}
         }
+
+        kBondIdx.resize(this->maxK - 1);
+        kBondFeat.resize(this->maxK - 1);
+        for (int i=0; i < this->maxK - 1; i++){
+            int64_t count = kFeat[i].size();
+            kBondIdx[i].resize(2, count);
+            kBondFeat[i].resize(count, 1);
+            for (int64_t j=0; j < count; j++){
+                kBondIdx[i](0, j) = kIdx[i][2 * j];
+                kBondIdx[i](1, j) = kIdx[i][2 * j + 1];
+                kBondFeat[i](j, 0) = kFeat[i][j];
+            }
+        }
+    }
+
+    std::tuple<MatRX<int64_t>, MatRX<int64_t>> molPreprocess::getAttentionBias(const RDKit::ROMol &mol){
+        MatRX<int64_t> degMatrix, distMatrix;
+        std::vector<MatRX<int64_t>> kBondIdx, kBondFeat;
+        this->getTopoFeat(mol, degMatrix, distMatrix, kBondIdx, kBondFeat);
+        return std::make_tuple(degMatrix, distMatrix);
+    }
+
+    std::tuple<std::vector<MatRX<int64_t>>, std::vector<MatRX<int64_t>>> molPreprocess::getKhopFeat(const RDKit::ROMol &mol){
+        MatRX<int64_t> degMatrix, distMatrix;
+        std::vector<MatRX<int64_t>> kBondIdx, kBondFeat;
+        this->getTopoFeat(mol, degMatrix, distMatrix, kBondIdx, kBondFeat);
         return std::make_tuple(kBondIdx, kBondFeat);
     }
 }
@@ -11,8 +11,8 @@ using namespace MolHandler {
     PYBIND11_MODULE(MolHandler, m){
         m.doc() = "A C++ Preprocess Module for Input Molecules";
         m.attr("distBlock") = DISTBLOCK;
-        m.attr("atomDim") = std::accumulate(ATOMFEATDIM.begin(), ATOMFEATDIM.end(), 0);
-        m.attr("bondDim") = std::accumulate(BONDFEATDIM.begin(), BONDFEATDIM.end(), 0);
+        m.attr("atomDim") = ATOMFEATSIZE;
+        m.attr("bondDim") = BONDFEATSIZE;
         pybind11::class_<inputData>(m, "inputData")
             .def(pybind11::init<const int&, const int&>(), Arg("num"), Arg("k"))
             .def_readwrite("atomFeat", &inputData::atomFeat)
@@ -36,7 +36,7 @@ using namespace MolHandler {
             .def_readonly("maxDeg", &molPreprocess::maxDeg)
             .def_readonly("maxK", &molPreprocess::maxK)
             .def_readonly("maxPath", &molPreprocess::maxPath)
-            .def_readwrite("vocab", &molPreprocess::vocab)
+            .def_property("vocab", [](const molPreprocess &self){return self.vocab;}, &molPreprocess::setVocabulary)
             .def("readVocabulary", &molPreprocess::readVocabulary, Arg("vdir"), Arg("extraToken"))
             .def("canonicalizeSmiles", &molPreprocess::canonicalizeSmiles, Arg("smi"))
             .def("generateSeq", &molPreprocess::generateSeq, Arg("smi"), Arg("vocab"))
@@ -44,7 +44,7 @@ using namespace MolHandler {
             .def("getQKVIndex", &molPreprocess::getQKVIndex, Arg("qIdx"), Arg("kvIdx"), Arg("preLength"), Arg("curLength"))
             .def("getBatchBond", &molPreprocess::getBatchBond, Arg("bondFeat"), Arg("curBondFeat"), Arg("bondIdx"), Arg("curBondIdx"), Arg("attnBondIdx"), Arg("preCumLength"), Arg("preLength"), Arg("curLength"))
             .def("getPaddingSeq", &molPreprocess::getPaddingSeq, Arg("unpadSeq"), Arg("seqFeat"), Arg("seqLength"), Arg("maxSeqLength"), Arg("needBos")=false, Arg("vocab"))
-            .def("generateBatch", &molPreprocess::generateBatch, Arg("smis"), Arg("lTasks"), Arg("needSeq"))
+            .def("generateBatch", pybind11::overload_cast<const std::vector<str>&, const std::vector<int64_t>&, const bool, const int>(&molPreprocess::generateBatch), Arg("smis"), Arg("lTasks"), Arg("needSeq")=false, Arg("numThreads")=0)
             .def("getAttentionBias", &molPreprocess::getAttentionBias, Arg("mol"))
             .def("getKhopFeat", &molPreprocess::getKhopFeat, Arg("mol"));
     }
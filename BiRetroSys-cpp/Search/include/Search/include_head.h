@@ -1,5 +1,6 @@
 #pragma once
 #include <queue>
+#include <shared_mutex>
 #include <graphviz/gvc.h>
 #include <GraphMol/Fingerprints/MorganFingerprints.h>
 
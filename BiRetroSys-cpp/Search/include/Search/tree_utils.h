@@ -3,6 +3,7 @@
 
 namespace Search {
     class reactionNode;
+    class openList;
 
     class moleculeNode {
         public:
@@ -21,11 +22,14 @@ namespace Search {
 
         Agnode_t *gvnode;
 
+        // slot in the open list, -1 when not queued
+        int heapPos;
+        openList *openNodes;
+
         moleculeNode(const int id, const str &mol, const float value, reactionNode *parent, bool isTerminal);
 
         void init();
         void update();
-        void updateVmt();
         void close();
         void getAncestor(std::unordered_set<str> &ancestor);
         void upToDownUpdate();
@@ -46,6 +50,8 @@ namespace Search {
         const float cost;
         float costs;
         float rn;
+        // sum of children rn along the reaction chain up to the root, vmt of every child is costs + pathRn
+        float pathRn;
 
         Agnode_t *gvnode;
 
@@ -53,7 +59,7 @@ namespace Search {
 
         void init();
         void update(float dRn);
-        void updateVmt();
+        void updateVmt(const bool force=true, const reactionNode *skip=nullptr);
         void vizPrepare(Agraph_t *curGraph);
 
         ~reactionNode();
@@ -62,6 +68,25 @@ namespace Search {
         float getCosts();
     };
 
+    // indexed binary min-heap over open molecule nodes ordered by (vmt, id), which is the node the
+    // first-minimum scan over molNodes used to pick. nodes keep their slot in heapPos, so a vmt change is one sift
+    class openList {
+        public:
+        void push(moleculeNode *node);
+        void remove(moleculeNode *node);
+        void update(moleculeNode *node);
+        moleculeNode *top() const;
+        int size() const;
+
+        private:
+        std::vector<moleculeNode*> heap;
+
+        bool less(const moleculeNode *a, const moleculeNode *b) const;
+        void place(moleculeNode *node, const int pos);
+        void siftUp(int pos);
+        void siftDown(int pos);
+    };
+
     class searchTree {
         public:
         str savePath;
@@ -73,6 +98,9 @@ namespace Search {
         const int singleSteps;
         const float T;
         bool hasFound;
+        // consistency check by the teacher-forced likelihood of the expanded molecule instead of a forward beam search,
+        // the check score is then the sequence probability rather than its share among the checkWidth beams
+        bool likelihoodCheck = false;
         std::ofstream searchLog;
 
         std::vector<moleculeNode*> molNodes;
@@ -81,6 +109,8 @@ namespace Search {
 
         searchTree(const str &target, const str &targetName, const std::unordered_set<str> *terminalMol, const int expansionWidth=20, const int checkWidth=20, const int singleSteps=150, const float T=1.0);
 
+        // open molecule with the lowest vmt, nullptr when nothing is left to expand
+        moleculeNode *selectNext();
         std::pair<bool, int> multiStepSearch(const int steps=100, const int earlyStop=-1, const float lowerBound=0.1, const bool consistCheck=true, const float checkLowerBound=0.01);
 
         ~searchTree();
@@ -89,6 +119,10 @@ namespace Search {
         std::vector<std::unordered_map<str, float>> inferFun(const std::vector<str> &smis, const bool isRetro=true);
         std::pair<std::vector<std::vector<str>>, std::vector<float>> filterRun(const str &expandSmi, const std::vector<std::unordered_map<str, float>> &expandResults, const float lowerBound, const bool consistCheck, const float checkLowerBound);
 
+        // route retro expansions through a shared service, so several trees batch their calls together. opt-in: a tree
+        // without a service calls plannedInferRun itself, callers running several trees at once install the same service on each
+        void setInferService(std::shared_ptr<Inference::InferService> service);
+
         bool finishSearch();
         void visualization(const str &name);
         void visualizationBest(const str &name);
@@ -96,11 +130,13 @@ namespace Search {
 
         private:
         moleculeNode *root;
-        valueModel *valModel;
-        Inference::SeqAGraphInfer *inferModel;
+        openList openNodes;
+        std::shared_ptr<valueModel> valModel;
+        std::shared_ptr<Inference::SeqAGraphInfer> inferModel;
+        std::shared_ptr<Inference::InferService> inferService;
 
         moleculeNode *addMol(const str &mol, reactionNode *parent, float value);
-        reactionNode *addReaction(const std::vector<str> &reaction, moleculeNode *parent, float cost, std::unordered_set<str> &ancestor);
+        reactionNode *addReaction(const std::vector<str> &reaction, moleculeNode *parent, float cost, const std::unordered_map<str, float> &values);
     };
 
     void loadTerminalMols(std::unordered_set<str> &finalSet, str &&molPath="");
@@ -2,20 +2,64 @@
 #include <Search/include_head.h>
 
 namespace Search {
+    // native evaluation of valueMLP.onnx (Gemm -> Relu -> ... -> Gemm -> log(exp(x) + c)) on fingerprint on-bits.
+    // weights are read once from the onnx initializers, and the first layer only sums the weight rows of the set bits
+    class mlpValueEngine {
+        public:
+        mlpValueEngine(const str &modelDir);
+
+        // one engine per model path for the whole process, so every search tree reuses the parsed weights
+        static std::shared_ptr<const mlpValueEngine> shared(const str &modelDir);
+
+        bool isLoaded() const;
+        int64_t inputDim() const;
+        std::vector<float> run(const std::vector<std::vector<int>> &onBits) const;
+
+        private:
+        bool loaded = false;
+        MatRX<float> firstWeight; // [dFP, hidden], transposed so that one bit is one contiguous row
+        VecRX<float> firstBias;
+        std::vector<MatRX<float>> weights; // [out, in] of the remaining layers
+        std::vector<VecRX<float>> biases;
+        float outputShift = 1;
+    };
+
     class valueModel {
         public:
         const int dFP = 2048;
 
-        valueModel(const str &device="cpu");
+        // native=true evaluates the MLP without ORT when the model graph is supported
+        valueModel(const str &device="cpu", const bool native=false);
 
         std::vector<float> valueRun(const std::vector<str> &smis);
+        // the native MLP is in use, false after a fallback to ORT
+        bool isNative() const;
 
         ~valueModel();
 
         private:
-        Ort::Env env;
-        Ort::Session *vModel = nullptr;
-        Ort::SessionOptions sessionOption;
+        std::shared_ptr<Ort::Session> vModel;
+        std::shared_ptr<const mlpValueEngine> nativeModel;
         Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
     };
+
+    // process-wide SMILES -> value memo shared by every search tree, readers only take the shared lock
+    class valueCache {
+        public:
+        static valueCache &instance();
+
+        bool find(const str &smi, float &value);
+        void insert(const str &smi, const float value);
+        int64_t size();
+        void clear();
+
+        valueCache(const valueCache &) = delete;
+        valueCache &operator=(const valueCache &) = delete;
+
+        private:
+        valueCache() = default;
+
+        std::shared_mutex cacheLock;
+        std::unordered_map<str, float> values;
+    };
 }
@@ -0,0 +1,67 @@
+#include <Search/tree_utils.h>
+
+namespace Search {
+    bool openList::less(const moleculeNode *a, const moleculeNode *b) const {
+        return a->vmt < b->vmt || (a->vmt == b->vmt && a->id < b->id);
+    }
+
+    void openList::place(moleculeNode *node, const int pos){
+        this->heap[pos] = node;
+        node->heapPos = pos;
+    }
+
+    void openList::siftUp(int pos){
+        moleculeNode *node = this->heap[pos];
+        while (pos > 0){
+            int parentPos = (pos - 1) / 2;
+            if (!this->less(node, this->heap[parentPos])) break;
+            this->place(this->heap[parentPos], pos);
+            pos = parentPos;
+        }
+        this->place(node, pos);
+    }
+
+    void openList::siftDown(int pos){
+        moleculeNode *node = this->heap[pos];
+        int heapSize = this->heap.size();
+        while (true){
+            int childPos = pos * 2 + 1;
+            if (childPos >= heapSize) break;
+            if (childPos + 1 < heapSize && this->less(this->heap[childPos + 1], this->heap[childPos])) childPos++;
+            if (!this->less(this->heap[childPos], node)) break;
+            this->place(this->heap[childPos], pos);
+            pos = childPos;
+        }
+        this->place(node, pos);
+    }
+
+    void openList::push(moleculeNode *node){
+        assert(node->heapPos < 0);
+        this->heap.push_back(node);
+        node->heapPos = this->heap.size() - 1;
+        this->siftUp(node->heapPos);
+    }
+
+    void openList::remove(moleculeNode *node){
+        if (node->heapPos < 0) return;
+        int pos = node->heapPos;
+        moleculeNode *last = this->heap.back();
+        this->heap.pop_back();
+        node->heapPos = -1;
+        if (last == node) return;
+
+        this->place(last, pos);
+        this->siftUp(pos);
+        this->siftDown(last->heapPos);
+    }
+
+    void openList::update(moleculeNode *node){
+        if (node->heapPos < 0) return;
+        this->siftUp(node->heapPos);
+        this->siftDown(node->heapPos);
+    }
+
+    moleculeNode *openList::top() const {return this->heap.size() ? this->heap[0] : nullptr;}
+
+    int openList::size() const {return this->heap.size();}
+}
@@ -12,6 +12,8 @@ namespace Search {
         this->vmt = 0;
 
         this->gvnode = nullptr;
+        this->heapPos = -1;
+        this->openNodes = nullptr;
 
         if (parent) parent->children.push_back(this);
     }
@@ -19,6 +21,7 @@ namespace Search {
     void moleculeNode::init(){
         assert(this->isOpen);
         this->isOpen = false;
+        if (this->openNodes) this->openNodes->remove(this);
         this->update();
     }
 
@@ -34,22 +37,9 @@ namespace Search {
         if (this->parent) this->parent->update(dRn);
     }
 
-    void moleculeNode::updateVmt(){
-        this->vmt = 0;
-        if (!this->parent) this->vmt = this->rn;
-        else{
-            this->vmt += this->parent->costs;
-            reactionNode *temp = this->parent;
-            while (temp){
-                for (const auto mol : temp->children) this->vmt += mol->rn;
-                temp = temp->parent->parent;
-            }
-            for (const auto &reaction : this->children) reaction->updateVmt();
-        }
-    }
-
     void moleculeNode::close(){
         this->isOpen = false;
+        if (this->openNodes) this->openNodes->remove(this);
         this->rn = std::numeric_limits<float>::max();
         if (this->parent) this->parent->update(this->rn);
     }
@@ -59,12 +49,16 @@ namespace Search {
         ancestor.insert(this->mol);
     }
 
+    // rn only changed along the path from this node to the root, so only the reactions on that path are
+    // recomputed, other subtrees are revisited only while their pathRn actually moves
     void moleculeNode::upToDownUpdate(){
+        std::vector<reactionNode*> chain;
+        for (reactionNode *temp=this->parent; temp; temp=temp->parent->parent) chain.push_back(temp);
+
+        for (int i=chain.size() - 1; i >= 0; i--) chain[i]->updateVmt(true, i ? chain[i - 1] : nullptr);
         if (!this->parent){
             for (const auto &child : this->children) child->updateVmt();
         }
-        else if (!this->parent->parent->parent) this->parent->updateVmt();
-        else this->parent->parent->upToDownUpdate();
     }
 
     void moleculeNode::vizPrepare(Agraph_t *curGraph){
@@ -90,6 +84,8 @@ namespace Search {
         this->isOpen = true;
         this->costs = 0;
         this->rn = 0;
+        // not computed yet, never equal to a fresh value
+        this->pathRn = std::numeric_limits<float>::quiet_NaN();
 
         this->gvnode = nullptr;
 
@@ -121,8 +117,20 @@ namespace Search {
         this->parent->update();
     }
 
-    void reactionNode::updateVmt(){
-        for (const auto mol : this->children) mol->updateVmt();
+    void reactionNode::updateVmt(const bool force, const reactionNode *skip){
+        float newPathRn = 0;
+        for (const auto mol : this->children) newPathRn += mol->rn;
+        if (this->parent->parent) newPathRn += this->parent->parent->pathRn;
+        if (!force && newPathRn == this->pathRn) return;
+
+        this->pathRn = newPathRn;
+        for (const auto mol : this->children){
+            mol->vmt = this->costs + this->pathRn;
+            if (mol->openNodes) mol->openNodes->update(mol);
+            for (const auto reaction : mol->children){
+                if (reaction != skip) reaction->updateVmt(false);
+            }
+        }
     }
 
     void reactionNode::vizPrepare(Agraph_t *curGraph){
@@ -146,8 +154,8 @@ namespace Search {
             outputLog("Target Molecule already in terminal Molecules.", this->searchLog);
         }
 
-        this->valModel = new valueModel();
-        this->inferModel = new Inference::SeqAGraphInfer();
+        this->valModel = std::make_shared<valueModel>("cpu", Inference::ModelRegistry::instance().config().nativeValue);
+        this->inferModel = Inference::ModelRegistry::instance().acquireInfer(Inference::usptofull, "cpu");
         this->root = this->addMol(this->target, nullptr, this->valueFun({this->target})[0]);
         this->excludeMols = {"", "CC"};
 
@@ -165,15 +173,7 @@ namespace Search {
         int step = 0;
         if (!this->hasFound){
             for (; step < steps; step++){
-                moleculeNode *nextMol = nullptr;
-                float minCost = MAXFLOAT;
-                for (auto p : this->molNodes){
-                    if (p->isOpen && p->vmt < minCost){
-                        minCost = p->vmt;
-                        nextMol = p;
-                    }
-                }
-
+                moleculeNode *nextMol = this->selectNext();
                 if (!nextMol){
                     outputLog("No open nodes, search terminate.", this->searchLog);
                     break;
@@ -193,19 +193,22 @@ namespace Search {
         return std::make_pair(this->finishSearch(), step+1);
     }
 
+    moleculeNode *searchTree::selectNext(){
+        moleculeNode *nextMol = this->openNodes.top();
+        return (nextMol && nextMol->vmt < MAXFLOAT) ? nextMol : nullptr;
+    }
+
     moleculeNode *searchTree::addMol(const str &mol, reactionNode *parent, float value){
         moleculeNode *newMol = new moleculeNode(this->molNodes.size(), mol, value, parent, this->terminalMol->find(mol) != this->terminalMol->end());
         this->molNodes.push_back(newMol);
+        newMol->openNodes = &this->openNodes;
+        if (newMol->isOpen) this->openNodes.push(newMol);
         return newMol;
     }
 
-    reactionNode *searchTree::addReaction(const std::vector<str> &reaction, moleculeNode *parent, float cost, std::unordered_set<str> &ancestor){
-        for (const auto &mol : reaction){
-            if (ancestor.find(mol) != ancestor.end()) return (reactionNode*)nullptr;
-        }
-        auto values = this->valueFun(reaction);
+    reactionNode *searchTree::addReaction(const std::vector<str> &reaction, moleculeNode *parent, float cost, const std::unordered_map<str, float> &values){
         reactionNode *newReaction = new reactionNode(this->reacNodes.size(), cost, parent);
-        for (int i=0; i < reaction.size(); i++) this->addMol(reaction[i], newReaction, values[i]);
+        for (const auto &mol : reaction) this->addMol(mol, newReaction, values.at(mol));
         newReaction->init();
         this->reacNodes.push_back(newReaction);
         return newReaction;
@@ -215,6 +218,7 @@ namespace Search {
         assert(!startMol->hasFound);
         if (scores.size() == 0){
             startMol->close();
+            startMol->upToDownUpdate();
             return false;
         }
         else{
@@ -224,10 +228,28 @@ namespace Search {
             });
             std::unordered_set<str> ancestor;
             startMol->getAncestor(ancestor);
-            for (int i=0; i < scores.size(); i++) this->addReaction(expandResults[i], startMol, scores[i], ancestor);
+
+            // value every new reactant of this expansion in one batch, terminals are never valued since their rn is 0
+            std::vector<int> accepted;
+            std::vector<str> valueInput;
+            std::unordered_map<str, float> values;
+            for (int i=0; i < scores.size(); i++){
+                if (std::any_of(expandResults[i].begin(), expandResults[i].end(), [&ancestor](const str &mol){return ancestor.find(mol) != ancestor.end();})) continue;
+                accepted.push_back(i);
+                for (const auto &mol : expandResults[i]){
+                    if (values.find(mol) != values.end()) continue;
+                    values[mol] = 0;
+                    if (this->terminalMol->find(mol) == this->terminalMol->end()) valueInput.push_back(mol);
+                }
+            }
+            auto valueRes = this->valueFun(valueInput);
+            for (int i=0; i < valueInput.size(); i++) values[valueInput[i]] = valueRes[i];
+
+            for (auto i : accepted) this->addReaction(expandResults[i], startMol, scores[i], values);
 
             if (startMol->children.size() == 0){
                 startMol->close();
+                startMol->upToDownUpdate();
                 return false;
             }
             else{
@@ -266,15 +288,28 @@ namespace Search {
         if (consistCheck && checkInput.size()){
             std::vector<std::vector<str>> tempRes2;
             std::vector<float> tempScore2;
-            auto checkRes = this->inferFun(checkInput, false);
-            int count = 0;
-            for (auto &check : checkRes){
-                auto findRes = check.find(expandSmi);
-                if (findRes != check.end() && findRes->second >= checkLowerBound){
-                    tempRes2.push_back(tempRes1[count]);
-                    tempScore2.push_back(tempScore1[count] * findRes->second);
+            if (this->likelihoodCheck){
+                std::vector<int64_t> lTask(checkInput.size(), 1);
+                auto checkScore = this->inferModel->scoreRun(checkInput, std::vector<str>(checkInput.size(), expandSmi), lTask, this->T, this->singleSteps);
+                for (int i=0; i < checkScore.size(); i++){
+                    float prob = exp(checkScore[i]);
+                    if (prob >= checkLowerBound){
+                        tempRes2.push_back(tempRes1[i]);
+                        tempScore2.push_back(tempScore1[i] * prob);
+                    }
+                }
+            }
+            else {
+                auto checkRes = this->inferFun(checkInput, false);
+                int count = 0;
+                for (auto &check : checkRes){
+                    auto findRes = check.find(expandSmi);
+                    if (findRes != check.end() && findRes->second >= checkLowerBound){
+                        tempRes2.push_back(tempRes1[count]);
+                        tempScore2.push_back(tempScore1[count] * findRes->second);
+                    }
+                    count++;
                 }
-                count++;
             }
 
             // if no results pass consistency check at first step, ignore it
@@ -297,14 +332,44 @@ namespace Search {
         }
     }
 
+    void searchTree::setInferService(std::shared_ptr<Inference::InferService> service){this->inferService = service;}
+
     std::vector<float> searchTree::valueFun(const std::vector<str> &smis){
-        return this->valModel->valueRun(smis);
+        auto &cache = valueCache::instance();
+        std::vector<float> res(smis.size(), 0);
+        std::vector<str> missSmis;
+        std::unordered_map<str, std::vector<int>> missPos;
+        for (int i=0; i < smis.size(); i++){
+            if (cache.find(smis[i], res[i])) continue;
+            auto &pos = missPos[smis[i]];
+            if (pos.empty()) missSmis.push_back(smis[i]);
+            pos.push_back(i);
+        }
+        if (missSmis.empty()) return res;
+
+        auto missRes = this->valModel->valueRun(missSmis);
+        for (int i=0; i < missSmis.size(); i++){
+            cache.insert(missSmis[i], missRes[i]);
+            for (auto pos : missPos[missSmis[i]]) res[pos] = missRes[i];
+        }
+        return res;
     }
 
     std::vector<std::unordered_map<str, float>> searchTree::inferFun(const std::vector<str> &smis, const bool isRetro){
         std::vector<int64_t> lTask = std::vector<int64_t>(smis.size(), isRetro ? 0 : 1);
         int64_t beamSize = isRetro ? this->expansionWidth : this->checkWidth;
-        auto [inferRes, inferScore] = this->inferModel->inferRun(smis, lTask, beamSize, smis.size(), 0.0, 1, this->singleSteps, 1, this->T, beamSize); // [batchSize * beamSize]
+        std::vector<str> inferRes; // [batchSize * beamSize]
+        std::vector<float> inferScore;
+        if (isRetro && this->inferService){
+            std::vector<std::future<Inference::inferResult>> pending;
+            for (int i=0; i < smis.size(); i++) pending.push_back(this->inferService->submit(smis[i], lTask[i], beamSize, 0.0, this->singleSteps, this->T, beamSize));
+            for (auto &p : pending){
+                auto res = p.get();
+                inferRes.insert(inferRes.end(), res.smis.begin(), res.smis.end());
+                inferScore.insert(inferScore.end(), res.scores.begin(), res.scores.end());
+            }
+        }
+        else {std::tie(inferRes, inferScore) = this->inferModel->plannedInferRun(smis, lTask, beamSize, 0.0, 1, this->singleSteps, 1, this->T, beamSize);}
 
         for (auto &p : smis) this->excludeMols.insert(p);
 
@@ -423,9 +488,6 @@ namespace Search {
         for (auto p : this->reacNodes) delete p;
         std::vector<moleculeNode*>().swap(this->molNodes);
         std::vector<reactionNode*>().swap(this->reacNodes);
-
-        delete this->valModel;
-        delete this->inferModel;
     }
 
     void loadTerminalMols(std::unordered_set<str> &finalSet, str &&molPath){
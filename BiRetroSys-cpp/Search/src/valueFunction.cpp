@@ -1,30 +1,256 @@
 #include <Search/value_fun.h>
 
 namespace Search {
-    valueModel::valueModel(const str &device){
-        if (device == "cuda"){
-            OrtCUDAProviderOptions cudaOption;
-            cudaOption.device_id = 0;
-            this->sessionOption.AppendExecutionProvider_CUDA(cudaOption);
+    // minimal protobuf wire-format reader, just enough to walk ModelProto -> GraphProto -> nodes / initializers
+    struct protoReader {
+        const uint8_t *cur;
+        const uint8_t *end;
+
+        protoReader(const uint8_t *data, const size_t size): cur(data), end(data + size){}
+
+        uint64_t varint(){
+            uint64_t res = 0;
+            for (int shift=0; this->cur < this->end && shift < 64; shift+=7){
+                uint8_t byte = *(this->cur++);
+                res |= (uint64_t)(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) return res;
+            }
+            throw std::runtime_error("truncated protobuf varint");
+        }
+
+        bool next(uint32_t &field, uint32_t &wire){
+            if (this->cur >= this->end) return false;
+            uint64_t tag = this->varint();
+            field = tag >> 3;
+            wire = tag & 7;
+            return true;
+        }
+
+        protoReader sub(){
+            uint64_t size = this->varint();
+            if (size > (uint64_t)(this->end - this->cur)) throw std::runtime_error("truncated protobuf field");
+            protoReader res(this->cur, size);
+            this->cur += size;
+            return res;
+        }
+
+        str string(){
+            auto field = this->sub();
+            return str((const char*)field.cur, field.end - field.cur);
+        }
+
+        float fixed32(){
+            float res;
+            if (this->end - this->cur < 4) throw std::runtime_error("truncated protobuf field");
+            std::memcpy(&res, this->cur, 4);
+            this->cur += 4;
+            return res;
+        }
+
+        void skip(const uint32_t wire){
+            if (wire == 0) this->varint();
+            else if (wire == 1) this->cur += 8;
+            else if (wire == 2) this->sub();
+            else if (wire == 5) this->cur += 4;
+            else throw std::runtime_error("unsupported protobuf wire type");
+        }
+    };
+
+    struct onnxTensor {
+        std::vector<int64_t> dims;
+        std::vector<float> data;
+    };
+
+    struct onnxNode {
+        str opType;
+        std::vector<str> inputs;
+        std::map<str, float> attributes;
+    };
+
+    static void parseTensor(protoReader tensor, str &name, onnxTensor &res){
+        uint32_t field, wire;
+        int64_t dataType = 1;
+        while (tensor.next(field, wire)){
+            if (field == 1 && wire == 0) res.dims.push_back(tensor.varint());
+            else if (field == 1 && wire == 2){
+                auto packed = tensor.sub();
+                while (packed.cur < packed.end) res.dims.push_back(packed.varint());
+            }
+            else if (field == 2 && wire == 0) dataType = tensor.varint();
+            else if (field == 4 && wire == 5) res.data.push_back(tensor.fixed32());
+            else if (field == 4 && wire == 2){
+                auto packed = tensor.sub();
+                while (packed.cur < packed.end) res.data.push_back(packed.fixed32());
+            }
+            else if (field == 8 && wire == 2) name = tensor.string();
+            else if (field == 9 && wire == 2){
+                auto raw = tensor.sub();
+                res.data.resize((raw.end - raw.cur) / sizeof(float));
+                std::memcpy(res.data.data(), raw.cur, res.data.size() * sizeof(float));
+            }
+            else tensor.skip(wire);
+        }
+        // only float tensors are used by the value model
+        if (dataType != 1) res.data.clear();
+    }
+
+    static void parseNode(protoReader node, onnxNode &res){
+        uint32_t field, wire;
+        while (node.next(field, wire)){
+            if (field == 1 && wire == 2) res.inputs.push_back(node.string());
+            else if (field == 4 && wire == 2) res.opType = node.string();
+            else if (field == 5 && wire == 2){
+                auto attribute = node.sub();
+                str name;
+                float value = 0;
+                while (attribute.next(field, wire)){
+                    if (field == 1 && wire == 2) name = attribute.string();
+                    else if (field == 2 && wire == 5) value = attribute.fixed32();
+                    else if (field == 3 && wire == 0) value = (int64_t)attribute.varint();
+                    else attribute.skip(wire);
+                }
+                res.attributes[name] = value;
+            }
+            else node.skip(wire);
+        }
+    }
+
+    mlpValueEngine::mlpValueEngine(const str &modelDir){
+        std::ifstream modelFile(modelDir, std::ios::in | std::ios::binary);
+        if (!modelFile.is_open()) return;
+        std::vector<uint8_t> buffer((std::istreambuf_iterator<char>(modelFile)), std::istreambuf_iterator<char>());
+
+        std::map<str, onnxTensor> initializers;
+        std::vector<onnxNode> nodes;
+        try {
+            protoReader model(buffer.data(), buffer.size());
+            uint32_t field, wire;
+            while (model.next(field, wire)){
+                if (field != 7 || wire != 2){
+                    model.skip(wire);
+                    continue;
+                }
+                auto graph = model.sub();
+                while (graph.next(field, wire)){
+                    if (field == 1 && wire == 2){
+                        nodes.push_back(onnxNode());
+                        parseNode(graph.sub(), nodes.back());
+                    }
+                    else if (field == 5 && wire == 2){
+                        str name;
+                        onnxTensor tensor;
+                        parseTensor(graph.sub(), name, tensor);
+                        initializers[name] = std::move(tensor);
+                    }
+                    else graph.skip(wire);
+                }
+            }
+        }
+        catch (const std::runtime_error &){return;}
+
+        // expected graph: Gemm (Relu Gemm)* Exp Add Log, anything else stays on ORT
+        auto getTensor = [&initializers](const str &name) -> const onnxTensor* {
+            auto findRes = initializers.find(name);
+            return findRes == initializers.end() || findRes->second.data.empty() ? nullptr : &findRes->second;
+        };
+        int nodeIdx = 0;
+        while (nodeIdx < nodes.size() && nodes[nodeIdx].opType == "Gemm"){
+            auto &gemm = nodes[nodeIdx];
+            auto getAttr = [&gemm](const str &name, const float defaultValue){
+                auto findRes = gemm.attributes.find(name);
+                return findRes == gemm.attributes.end() ? defaultValue : findRes->second;
+            };
+            if (gemm.inputs.size() != 3 || getAttr("transB", 0) != 1 || getAttr("transA", 0) != 0 || getAttr("alpha", 1) != 1 || getAttr("beta", 1) != 1) return;
+            auto weight = getTensor(gemm.inputs[1]);
+            auto bias = getTensor(gemm.inputs[2]);
+            if (!weight || !bias || weight->dims.size() != 2 || bias->data.size() != weight->dims[0]) return;
+
+            MatRX<float> w = Eigen::Map<const MatRX<float>>(weight->data.data(), weight->dims[0], weight->dims[1]);
+            VecRX<float> b = Eigen::Map<const VecRX<float>>(bias->data.data(), bias->data.size());
+            if (!this->firstWeight.size()){
+                this->firstWeight = w.transpose();
+                this->firstBias = b;
+            }
+            else {
+                auto lastDim = this->weights.size() ? this->weights.back().rows() : this->firstWeight.cols();
+                if (w.cols() != lastDim) return;
+                this->weights.push_back(w);
+                this->biases.push_back(b);
+            }
+            nodeIdx++;
+            if (nodeIdx < nodes.size() && nodes[nodeIdx].opType == "Relu") nodeIdx++;
+            else break;
         }
+        if (!this->firstWeight.size() || nodeIdx + 3 != nodes.size()) return;
+        if (nodes[nodeIdx].opType != "Exp" || nodes[nodeIdx + 1].opType != "Add" || nodes[nodeIdx + 2].opType != "Log") return;
+        auto lastDim = this->weights.size() ? this->weights.back().rows() : this->firstWeight.cols();
+        if (lastDim != 1) return;
+        for (const auto &input : nodes[nodeIdx + 1].inputs){
+            auto shift = getTensor(input);
+            if (shift && shift->data.size() == 1) this->outputShift = shift->data[0];
+        }
+        this->loaded = true;
+    }
+
+    std::shared_ptr<const mlpValueEngine> mlpValueEngine::shared(const str &modelDir){
+        static std::mutex engineLock;
+        static std::map<str, std::shared_ptr<const mlpValueEngine>> engines;
+        std::lock_guard<std::mutex> lock(engineLock);
+        // an unsupported model is kept as well, so the next tree falls back to ORT without parsing it again
+        auto &engine = engines[modelDir];
+        if (!engine) engine = std::make_shared<const mlpValueEngine>(modelDir);
+        return engine;
+    }
+
+    bool mlpValueEngine::isLoaded() const {return this->loaded;}
+
+    int64_t mlpValueEngine::inputDim() const {return this->firstWeight.rows();}
+
+    std::vector<float> mlpValueEngine::run(const std::vector<std::vector<int>> &onBits) const {
+        const int64_t bsz = onBits.size();
+        MatRX<float> hidden(bsz, this->firstWeight.cols());
+        for (int64_t i=0; i < bsz; i++){
+            hidden.row(i) = this->firstBias;
+            for (const int &idx : onBits[i]) hidden.row(i) += this->firstWeight.row(idx);
+        }
+        for (int64_t layer=0; layer < this->weights.size(); layer++){
+            hidden = hidden.cwiseMax(0.0f);
+            hidden = (hidden * this->weights[layer].transpose()).rowwise() + this->biases[layer];
+        }
+
+        std::vector<float> res(bsz);
+        for (int64_t i=0; i < bsz; i++) res[i] = log(exp(hidden(i, 0)) + this->outputShift);
+        return res;
+    }
+
+    valueModel::valueModel(const str &device, const bool native){
         str curPath = std::filesystem::current_path().parent_path();
         const str valueModelDir = curPath + "/Models/valueMLP.onnx";
-        this->vModel = new Ort::Session(this->env, valueModelDir.c_str(), this->sessionOption);
+        if (native){
+            this->nativeModel = mlpValueEngine::shared(valueModelDir);
+            if (this->nativeModel->isLoaded() && this->nativeModel->inputDim() == this->dFP) return;
+            this->nativeModel.reset();
+        }
+        this->vModel = Inference::ModelRegistry::instance().acquireSession(valueModelDir, device);
     }
 
     std::vector<float> valueModel::valueRun(const std::vector<str> &smis){
         const std::vector<const char*> inputsName = {"molFP"};
         const std::vector<const char*> outputsName = {"molValue"};
         const int bsz = smis.size();
+        if (!bsz) return {};
 
-        std::vector<float> inputs;
-        for (const str &s : smis){
-            auto res = RDKit::MorganFingerprints::getFingerprintAsBitVect(*RDKit::SmilesToMol(s), 2, this->dFP);
-            std::vector<float> bitsVec(this->dFP, 0);
-            std::vector<int> bits(res->getNumBits());
-            res->getOnBits(bits);
-            for (const int &idx : bits) bitsVec[idx] = 1;
-            inputs.insert(inputs.end(), bitsVec.begin(), bitsVec.end());
+        std::vector<std::vector<int>> onBits(bsz);
+        for (int i=0; i < bsz; i++){
+            std::unique_ptr<RDKit::ROMol> mol(RDKit::SmilesToMol(smis[i]));
+            std::unique_ptr<ExplicitBitVect> res(RDKit::MorganFingerprints::getFingerprintAsBitVect(*mol, 2, this->dFP));
+            res->getOnBits(onBits[i]);
+        }
+        if (this->nativeModel) return this->nativeModel->run(onBits);
+
+        std::vector<float> inputs(bsz * this->dFP, 0);
+        for (int i=0; i < bsz; i++){
+            for (const int &idx : onBits[i]) inputs[i * this->dFP + idx] = 1;
         }
         std::vector<int64_t> inputSize = {bsz, this->dFP};
         Ort::Value inputOrt = Inference::convertTensor<float, float>(inputs.data(), inputSize, this->memInfo);
@@ -39,7 +265,35 @@ namespace Search {
         return std::vector<float>(res, res + bsz);
     }
 
-    valueModel::~valueModel(){
-        delete this->vModel;
+    bool valueModel::isNative() const {return this->nativeModel != nullptr;}
+
+    valueModel::~valueModel(){}
+
+    valueCache &valueCache::instance(){
+        static valueCache cache;
+        return cache;
+    }
+
+    bool valueCache::find(const str &smi, float &value){
+        std::shared_lock<std::shared_mutex> lock(this->cacheLock);
+        auto findRes = this->values.find(smi);
+        if (findRes == this->values.end()) return false;
+        value = findRes->second;
+        return true;
+    }
+
+    void valueCache::insert(const str &smi, const float value){
+        std::unique_lock<std::shared_mutex> lock(this->cacheLock);
+        this->values[smi] = value;
+    }
+
+    int64_t valueCache::size(){
+        std::shared_lock<std::shared_mutex> lock(this->cacheLock);
+        return this->values.size();
+    }
+
+    void valueCache::clear(){
+        std::unique_lock<std::shared_mutex> lock(this->cacheLock);
+        this->values.clear();
     }
 }
\ No newline at end of file
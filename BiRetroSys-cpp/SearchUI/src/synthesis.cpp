@@ -13,14 +13,7 @@ void multiStepSynthesis::startSearch(){
     auto searchBegin = std::chrono::high_resolution_clock::now();
     if (!this->tree->hasFound){
         for (; step < this->treeSettings.multiSearchSteps; step++){
-            Search::moleculeNode *nextMol = nullptr;
-            float minCost = MAXFLOAT;
-            for (auto p : this->tree->molNodes){
-                if (p->isOpen && p->vmt < minCost){
-                    minCost = p->vmt;
-                    nextMol = p;
-                }
-            }
+            Search::moleculeNode *nextMol = this->tree->selectNext();
 
             // no open nodes
             if (!nextMol){
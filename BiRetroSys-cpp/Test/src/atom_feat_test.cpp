@@ -0,0 +1,128 @@
+#include <Test/include_head.h>
+#include <MolHandler/chem_utils.h>
+#include <GraphMol/PeriodicTable.h>
+
+// compile-time atom / bond lookup tables against the previous std::map lookups,
+// on every atom and bond of the USPTO-50k test split, labels have to be identical
+
+// previous tables and lookups, kept here as the reference
+namespace legacy {
+    using namespace MolHandler;
+    template <typename T1, typename T2>
+    std::map<T2, int> ilist2map(const T1 &ilist){
+        std::map<T2, int> temp;
+        int i = 0;
+        for (auto elem : ilist){temp.insert(std::make_pair(elem, i)); ++i;}
+        return temp;
+    }
+    const auto atomMap = ilist2map<std::vector<str>, str>(std::vector<str>(ATOMLIST.begin(), ATOMLIST.end()));
+    const auto hybridMap = ilist2map<decltype(HYBRIDLIST), RDKit::Atom::HybridizationType>(HYBRIDLIST);
+    const auto chiralMap = ilist2map<decltype(CHIRALIST), RDKit::Atom::ChiralType>(CHIRALIST);
+    const auto rsMap = ilist2map<std::vector<str>, str>(std::vector<str>(RSLIST.begin(), RSLIST.end()));
+    const auto degreeMap = ilist2map<decltype(NDEGREE), int>(NDEGREE);
+    const auto chargeMap = ilist2map<decltype(NCHARGE), int>(NCHARGE);
+    const auto valenceMap = ilist2map<decltype(NVALENCE), int>(NVALENCE);
+    const auto hsMap = ilist2map<decltype(NHS), int>(NHS);
+    const auto bondMap = ilist2map<decltype(BONDLIST), RDKit::Bond::BondType>(BONDLIST);
+    const auto stereoMap = ilist2map<decltype(STEREOLIST), RDKit::Bond::BondStereo>(STEREOLIST);
+
+    void getAtomFeat(const RDKit::Atom &atom, int *container, const int lTask, const int lClass, const int lRoot, const int lShuffle){
+        auto atomSymbol = atomMap.find(atom.getSymbol());
+        if (atomSymbol == atomMap.end()){*(container) = atomMap.at("<unk>");}
+        else {
+            *(container) = atomSymbol->second;
+            *(container + 1) = mapGet(degreeMap, int(atom.getDegree()), 9);
+            *(container + 2) = mapGet(chargeMap, atom.getFormalCharge(), 4);
+            *(container + 3) = mapGet(valenceMap, int(atom.getTotalValence()), 6);
+            *(container + 4) = mapGet(hsMap, int(atom.getTotalNumHs()), 4);
+            *(container + 5) = mapGet(chiralMap, atom.getChiralTag(), 2);
+            str rsTag = "";
+            if (atom.getPropIfPresent("_CIPCode", rsTag)){*(container + 6) = mapGet(rsMap, rsTag, 2);}
+            else {*(container + 6) = 2;}
+            *(container + 7) = mapGet(hybridMap, atom.getHybridization(), 4);
+            *(container + 8) = atom.getIsAromatic();
+            auto tempIt = {lRoot, lShuffle, lTask, lClass};
+            std::copy(tempIt.begin(), tempIt.end(), container + 9);
+        }
+    }
+
+    void getBondFeat(const RDKit::Bond &bond, const RDKit::RingInfo &ringInfo, int *container){
+        auto bondType = bondMap.find(bond.getBondType());
+        if (bondType != bondMap.end()){
+            *(container) = bondType->second;
+            *(container + 1) = mapGet(stereoMap, bond.getStereo(), 0);
+            *(container + 2) = bond.getIsConjugated();
+            *(container + 3) = bool(ringInfo.numBondRings(bond.getIdx()));
+        }
+    }
+}
+
+int main(){
+    using namespace MolHandler;
+    // ATOMNUMLIST has to name the same elements as ATOMLIST
+    int64_t tableMismatch = 0;
+    for (int i=0; i < ATOMNUMLIST.size(); i++){
+        if (RDKit::PeriodicTable::getTable()->getElementSymbol(ATOMNUMLIST[i]) != ATOMLIST[i]) tableMismatch++;
+    }
+
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/50k/token(test).txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<std::unique_ptr<RDKit::ROMol>> mols;
+    str line;
+    while (std::getline(testData, line)){
+        auto tab1 = line.find('\t'), tab2 = line.find('\t', tab1 + 1);
+        for (auto smi : {line.substr(0, tab1), line.substr(tab1 + 1, tab2 - tab1 - 1)}){
+            std::unique_ptr<RDKit::ROMol> mol(RDKit::SmilesToMol(smi));
+            if (mol) mols.push_back(std::move(mol));
+        }
+    }
+    // atoms outside ATOMLIST, charges / Hs / valences outside the lists
+    for (str smi : {"[Xe]", "*C", "[U+3]", "[NH2-]", "[CH2]", "[O-2]", "[SiH4]", "F[S](F)(F)(F)(F)F", "C/C=C/Cl", "[2H]C"}){
+        std::unique_ptr<RDKit::ROMol> mol(RDKit::SmilesToMol(smi));
+        if (mol) mols.push_back(std::move(mol));
+    }
+
+    int64_t atomNum = 0, bondNum = 0, labelMismatch = 0;
+    double legacyUs = 0, tableUs = 0;
+    int legacyLabel[ATOMFEATNUM], tableLabel[ATOMFEATNUM];
+    for (auto &mol : mols){
+        auto atomBegin = std::chrono::high_resolution_clock::now();
+        for (auto atom : mol->atoms()){
+            std::fill(legacyLabel, legacyLabel + ATOMFEATNUM, -1);
+            legacy::getAtomFeat(*atom, legacyLabel, 1, 2, 3, 4);
+        }
+        auto atomMid = std::chrono::high_resolution_clock::now();
+        for (auto atom : mol->atoms()){
+            std::fill(tableLabel, tableLabel + ATOMFEATNUM, -1);
+            getAtomFeat(*atom, tableLabel, 1, 2, 3, 4);
+        }
+        auto atomEnd = std::chrono::high_resolution_clock::now();
+        legacyUs += std::chrono::duration_cast<std::chrono::nanoseconds>(atomMid - atomBegin).count() * 1e-3;
+        tableUs += std::chrono::duration_cast<std::chrono::nanoseconds>(atomEnd - atomMid).count() * 1e-3;
+
+        for (auto atom : mol->atoms()){
+            std::fill(legacyLabel, legacyLabel + ATOMFEATNUM, -1);
+            std::fill(tableLabel, tableLabel + ATOMFEATNUM, -1);
+            legacy::getAtomFeat(*atom, legacyLabel, 1, 2, 3, 4);
+            getAtomFeat(*atom, tableLabel, 1, 2, 3, 4);
+            labelMismatch += !std::equal(legacyLabel, legacyLabel + ATOMFEATNUM, tableLabel);
+            atomNum++;
+        }
+        const auto &ringInfo = *(mol->getRingInfo());
+        for (auto bond : mol->bonds()){
+            int legacyBond[BONDFEATNUM], tableBond[BONDFEATNUM];
+            std::fill(legacyBond, legacyBond + BONDFEATNUM, -1);
+            std::fill(tableBond, tableBond + BONDFEATNUM, -1);
+            legacy::getBondFeat(*bond, ringInfo, legacyBond);
+            getBondFeat(*bond, ringInfo, tableBond);
+            labelMismatch += !std::equal(legacyBond, legacyBond + BONDFEATNUM, tableBond);
+            bondNum++;
+        }
+    }
+    std::cout << "molecules: " << mols.size() << " atoms: " << atomNum << " bonds: " << bondNum << std::endl;
+    std::cout << "map lookup(ns/atom): " << legacyUs * 1e3 / atomNum << std::endl;
+    std::cout << "table lookup(ns/atom): " << tableUs * 1e3 / atomNum << std::endl;
+    std::cout << "table mismatches: " << tableMismatch << " label mismatches: " << labelMismatch << std::endl;
+    return tableMismatch + labelMismatch > 0 ? 1 : 0;
+}
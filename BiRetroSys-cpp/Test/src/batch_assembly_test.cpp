@@ -0,0 +1,102 @@
+#include <Test/include_head.h>
+
+// two-pass generateBatch (with and without a reused inputData) against the previous per-molecule concat assembly,
+// on batches of routes_test.txt targets, outputs have to be identical
+
+// previous assembly, kept here as the reference
+MolHandler::inputData legacyBatch(MolHandler::molPreprocess &molHandler, const std::vector<str> &smis, const std::vector<int64_t> &lTasks, const int64_t maxK){
+    using namespace MolHandler;
+    inputData inData(smis.size(), maxK);
+    int64_t preCumLength = 0, preLength = 0;
+    for (int64_t batchId=0; batchId < smis.size(); batchId++){
+        auto graph = molHandler.getMolGraph(smis[batchId], lTasks[batchId], -1);
+        int64_t atomNum = graph.atomNum;
+        inData.atomFeat = inData.atomFeat.size() > 0 ? concat(inData.atomFeat, graph.atomFeat) : graph.atomFeat;
+        inData.deg = inData.deg.size() > 0 ? concat(inData.deg, graph.deg, -1) : graph.deg;
+        inData.dist = inData.dist.size() > 0 ? concat(inData.dist, graph.dist, -1) : graph.dist;
+
+        MatRX<int64_t> temp(1, atomNum);
+        for (int64_t i=0; i < atomNum; i++){temp(0, i) = preLength + i;}
+        MatRX<int64_t> tempKV = temp.replicate(1, atomNum);
+        MatRX<int64_t> tempQ = temp.replicate(atomNum, 1).reshaped(1, atomNum * atomNum);
+        inData.queryIdx = inData.queryIdx.size() > 0 ? concat<int64_t>(inData.queryIdx, tempQ, -1) : tempQ;
+        inData.keyIdx = inData.keyIdx.size() > 0 ? concat<int64_t>(inData.keyIdx, tempKV, -1) : tempKV;
+
+        inData.bondFeat = inData.bondFeat.size() > 0 ? concat(inData.bondFeat, graph.bondFeat) : graph.bondFeat;
+        for (int i=0; i < maxK; i++){
+            auto &idx = graph.bondIdx[i];
+            if (idx.size() == 0) continue;
+            idx = idx.array() + preLength;
+            MatRX<int64_t> attnIdx = (idx.row(0).array() - preLength) * atomNum + (idx.row(1).array() - preLength) + preCumLength;
+            inData.bondIdx[i] = inData.bondIdx[i].size() > 0 ? concat(inData.bondIdx[i], idx, -1) : idx;
+            inData.attnBondIdx[i] = inData.attnBondIdx[i].size() > 0 ? concat(inData.attnBondIdx[i], attnIdx, -1) : attnIdx;
+            if (i < maxK - 1){
+                auto &feat = graph.kBondFeat[i];
+                inData.kBondFeat[i] = inData.kBondFeat[i].size() > 0 ? concat(inData.kBondFeat[i], feat) : feat;
+            }
+        }
+        inData.graphLength(0, batchId) = atomNum;
+        preCumLength += (atomNum * atomNum);
+        preLength += atomNum;
+    }
+    inData.bondSplit(0, 0) = inData.bondFeat.rows();
+    for (int i=1; i < maxK; i++){inData.bondSplit(0, i) = inData.kBondFeat[i-1].rows();}
+    for (int i=0; i < inData.lTask.cols(); i++){inData.lTask(0, i) = lTasks[i];}
+    inData.lClass.setZero();
+    return inData;
+}
+
+bool sameBatch(const MolHandler::inputData &a, const MolHandler::inputData &b){
+    bool same = a.atomFeat == b.atomFeat && a.bondFeat == b.bondFeat && a.deg == b.deg && a.dist == b.dist
+        && a.queryIdx == b.queryIdx && a.keyIdx == b.keyIdx && a.graphLength == b.graphLength
+        && a.bondSplit == b.bondSplit && a.lTask == b.lTask && a.lClass == b.lClass;
+    for (int i=0; i < a.bondIdx.size(); i++){
+        same = same && a.bondIdx[i].rows() == b.bondIdx[i].rows() && a.bondIdx[i].cols() == b.bondIdx[i].cols() && a.bondIdx[i] == b.bondIdx[i];
+        same = same && a.attnBondIdx[i].rows() == b.attnBondIdx[i].rows() && a.attnBondIdx[i].cols() == b.attnBondIdx[i].cols() && a.attnBondIdx[i] == b.attnBondIdx[i];
+    }
+    for (int i=0; i < a.kBondFeat.size(); i++){
+        same = same && a.kBondFeat[i].rows() == b.kBondFeat[i].rows() && a.kBondFeat[i].cols() == b.kBondFeat[i].cols() && a.kBondFeat[i] == b.kBondFeat[i];
+    }
+    return same;
+}
+
+int main(){
+    const int iters = 10;
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> targets;
+    str tgt;
+    // canonical inputs, so the reference can skip canonicalizeSmiles
+    while (std::getline(testData, tgt)){
+        std::unique_ptr<RDKit::ROMol> mol(RDKit::SmilesToMol(tgt));
+        if (mol) targets.push_back(RDKit::MolToSmiles(*mol));
+    }
+
+    MolHandler::molPreprocess molHandler;
+    const int64_t maxK = molHandler.maxK;
+    MolHandler::inputData reused(0, maxK);
+    int failed = 0;
+    std::cout << "batch\tlegacy(us)\ttwo-pass(us)\treused(us)\tidentical" << std::endl;
+    for (int64_t batchSize : {1, 8, 32, 128}){
+        std::vector<str> smis(targets.begin(), targets.begin() + std::min<int64_t>(batchSize, targets.size()));
+        std::vector<int64_t> lTasks(smis.size(), 0);
+
+        MolHandler::inputData legacyRes(0, maxK), twoPassRes(0, maxK);
+        auto legacyBegin = std::chrono::high_resolution_clock::now();
+        for (int i=0; i < iters; i++) legacyRes = legacyBatch(molHandler, smis, lTasks, maxK);
+        auto legacyEnd = std::chrono::high_resolution_clock::now();
+        for (int i=0; i < iters; i++) twoPassRes = molHandler.generateBatch(smis, lTasks);
+        auto twoPassEnd = std::chrono::high_resolution_clock::now();
+        for (int i=0; i < iters; i++) molHandler.generateBatch(smis, lTasks, reused);
+        auto reusedEnd = std::chrono::high_resolution_clock::now();
+
+        double legacyUs = std::chrono::duration_cast<std::chrono::nanoseconds>(legacyEnd - legacyBegin).count() * 1e-3 / iters;
+        double twoPassUs = std::chrono::duration_cast<std::chrono::nanoseconds>(twoPassEnd - legacyEnd).count() * 1e-3 / iters;
+        double reusedUs = std::chrono::duration_cast<std::chrono::nanoseconds>(reusedEnd - twoPassEnd).count() * 1e-3 / iters;
+        bool identical = sameBatch(legacyRes, twoPassRes) && sameBatch(legacyRes, reused);
+        std::cout << smis.size() << "\t" << legacyUs << "\t" << twoPassUs << "\t" << reusedUs << "\t" << (identical ? "yes" : "NO") << std::endl;
+        failed += !identical;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+#include <Test/include_head.h>
+#include <Inference/model_utils.h>
+
+// routes_test.txt targets mixed with a few very large molecules, planned micro-batches against one inferRun
+// over the whole batch: graph bytes, time and per-molecule results (returned in input order)
+int main(){
+    const int64_t beamSize = 10;
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> smis;
+    str tgt;
+    while (std::getline(testData, tgt) && smis.size() < 30) smis.push_back(tgt);
+    // ~150 heavy atoms each
+    for (int i=0; i < 2; i++){
+        str smi = "C";
+        for (int j=0; j < 15; j++) smi += "c1ccc(cc1)C(=O)N";
+        smis.insert(smis.begin() + 10 * (i + 1), smi);
+    }
+    std::vector<int64_t> lTask(smis.size(), 0);
+
+    auto model = Inference::ModelRegistry::instance().acquireInfer(Inference::uspto50k, "cpu");
+    auto &planner = model->batchPlanner;
+    auto groups = planner.plan(smis, beamSize);
+
+    std::vector<int64_t> seen(smis.size(), 0);
+    int64_t sumAtom = 0, sumSquare = 0, maxAtom = 0;
+    for (auto &smi : smis){
+        auto atomNum = Inference::BatchPlanner::countAtoms(smi);
+        sumAtom += atomNum;
+        sumSquare += atomNum * atomNum;
+        maxAtom = std::max(maxAtom, atomNum);
+    }
+    std::cout << "whole batch: " << smis.size() << " molecules, padding " << 1.0 - (double)sumAtom / (smis.size() * maxAtom)
+        << ", estimate(MB) " << planner.estimateBytes(smis.size(), maxAtom, sumSquare, beamSize) / 1048576.0 << std::endl;
+    for (auto &group : groups){
+        int64_t groupSum = 0, groupSquare = 0, groupMax = 0;
+        for (auto idx : group){
+            auto atomNum = Inference::BatchPlanner::countAtoms(smis[idx]);
+            groupSum += atomNum;
+            groupSquare += atomNum * atomNum;
+            groupMax = std::max(groupMax, atomNum);
+            seen[idx]++;
+        }
+        std::cout << "micro-batch: " << group.size() << " molecules, max atoms " << groupMax << ", padding " << 1.0 - (double)groupSum / (group.size() * groupMax)
+            << ", estimate(MB) " << planner.estimateBytes(group.size(), groupMax, groupSquare, beamSize) / 1048576.0 << std::endl;
+    }
+    bool covered = std::all_of(seen.begin(), seen.end(), [](const int64_t n){return n == 1;});
+
+    auto wholeBegin = std::chrono::high_resolution_clock::now();
+    auto [wholeRes, wholeScore] = model->inferRun(smis, lTask, beamSize, smis.size(), 0.0, 1, 150, 1, 1.0, beamSize);
+    auto wholeEnd = std::chrono::high_resolution_clock::now();
+    auto [plannedRes, plannedScore] = model->plannedInferRun(smis, lTask, beamSize, 0.0, 1, 150, 1, 1.0, beamSize);
+    auto plannedEnd = std::chrono::high_resolution_clock::now();
+
+    int64_t sameTop = 0;
+    for (int64_t i=0; i < smis.size(); i++) sameTop += (wholeRes[i * beamSize] == plannedRes[i * beamSize]);
+    std::cout << "every molecule planned once: " << (covered ? "yes" : "NO") << std::endl;
+    std::cout << "whole batch(s): " << std::chrono::duration_cast<std::chrono::milliseconds>(wholeEnd - wholeBegin).count() * 1e-3 << std::endl;
+    std::cout << "planned(s): " << std::chrono::duration_cast<std::chrono::milliseconds>(plannedEnd - wholeEnd).count() * 1e-3 << std::endl;
+    std::cout << "same top-1: " << sameTop << " / " << smis.size() << std::endl;
+    return covered ? 0 : 1;
+}
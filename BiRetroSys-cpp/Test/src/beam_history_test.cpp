@@ -0,0 +1,165 @@
+#include <Test/include_head.h>
+#include <Inference/tensor_utils.h>
+#include <random>
+
+// beam search bookkeeping through BeamHistory (one (token, parent) row per step, sequences traced on demand) against
+// the previous full-sequence copies, kept here as the reference. batches of random logits are decoded with an EOS bias
+// growing at a different rate per batch element, so elements finish and drop out at different steps. both sides take
+// their candidates from fusedBeamTopK (checked against the padded softmax path in beam_topk_test, whose rounding can tip
+// the early-stop test of a near tie), finalized hypotheses and scores have to be identical
+
+// previous SearchHypotheses, every hypothesis is pushed as a copy of its full token sequence
+struct legacyHypotheses {
+    int64_t beamSize;
+    float lengthPenalty;
+    float worstScore = 1e9;
+    std::vector<std::tuple<float, std::vector<int64_t>>> beams;
+
+    void push(const std::vector<int64_t> &hyp, float sumLogProbs){
+        auto curScore = sumLogProbs / (pow(hyp.size(), this->lengthPenalty));
+        if (this->beams.size() < this->beamSize || curScore > this->worstScore){
+            this->beams.push_back(std::make_tuple(curScore, hyp));
+            std::sort(this->beams.begin(), this->beams.end(), [](const auto &a, const auto &b){return std::get<0>(a) > std::get<0>(b);});
+            if (this->beams.size() > this->beamSize){
+                this->beams.pop_back();
+                this->worstScore = std::get<0>(this->beams.back());
+            }
+            else {this->worstScore = curScore < this->worstScore ? curScore : this->worstScore;}
+        }
+    }
+
+    bool isDone(float bestProbs, int64_t curLength){
+        if (this->beams.size() < this->beamSize) return false;
+        return this->worstScore >= bestProbs / (pow(curLength, this->lengthPenalty));
+    }
+};
+
+// previous SearchMethods bookkeeping for one beam group: allToken holds the whole sequence of every row and is
+// rebuilt from the parent rows every step
+struct legacyBeamSearch {
+    int64_t batchSize, beamSize, eosIds, padIds, returnNum;
+    float T;
+    std::vector<std::vector<int64_t>> allToken;
+    std::vector<float> beamScore;
+    std::vector<bool> done;
+    std::vector<legacyHypotheses> hyps;
+
+    legacyBeamSearch(int64_t batchSize, int64_t beamSize, int64_t bosIds, int64_t eosIds, int64_t padIds, float lengthPenalty, float T, int64_t returnNum)
+    : batchSize(batchSize), beamSize(beamSize), eosIds(eosIds), padIds(padIds), returnNum(returnNum), T(T){
+        this->allToken = std::vector<std::vector<int64_t>>(batchSize * beamSize, std::vector<int64_t>(1, bosIds));
+        this->beamScore = std::vector<float>(batchSize * beamSize, -std::numeric_limits<float>::infinity());
+        for (int64_t b=0; b < batchSize; b++) this->beamScore[b * beamSize] = 0;
+        this->done = std::vector<bool>(batchSize, false);
+        this->hyps = std::vector<legacyHypotheses>(batchSize, legacyHypotheses{beamSize, lengthPenalty});
+    }
+
+    bool isDone(){return std::all_of(this->done.begin(), this->done.end(), [](const bool a){return a;});}
+
+    // logits of every row, finished elements included
+    void generate(const std::vector<float> &logits, const int64_t vocabSize){
+        const int64_t rows = this->batchSize * this->beamSize;
+        const int64_t candidateSize = this->beamSize * 2;
+        std::vector<int64_t> every(this->batchSize);
+        std::iota(every.begin(), every.end(), 0);
+        std::vector<float> nextScore(this->batchSize * candidateSize);
+        std::vector<int64_t> nextToken(this->batchSize * candidateSize);
+        Inference::fusedBeamTopK(logits.data(), vocabSize, vocabSize, this->beamScore.data(), every, this->batchSize, this->beamSize, candidateSize, this->T, nextScore.data(), nextToken.data());
+
+        const int64_t curLength = this->allToken[0].size();
+        std::vector<float> nextBeamScore(rows, 0);
+        std::vector<int64_t> nextBeamToken(rows, this->padIds), nextBeamIdx(rows, 0);
+        for (int64_t b=0; b < this->batchSize; b++){
+            if (this->done[b]) continue;
+            int64_t beamIdx = 0;
+            for (int64_t rank=0; rank < candidateSize; rank++){
+                const int64_t row = b * this->beamSize + nextToken[b * candidateSize + rank] / vocabSize;
+                const int64_t token = nextToken[b * candidateSize + rank] % vocabSize;
+                const float score = nextScore[b * candidateSize + rank];
+                if (token == this->eosIds){
+                    if (rank >= this->beamSize) continue;
+                    this->hyps[b].push(this->allToken[row], score);
+                }
+                else {
+                    nextBeamScore[b * this->beamSize + beamIdx] = score;
+                    nextBeamToken[b * this->beamSize + beamIdx] = token;
+                    nextBeamIdx[b * this->beamSize + beamIdx] = row;
+                    beamIdx++;
+                }
+                if (beamIdx == this->beamSize) break;
+            }
+            this->done[b] = this->hyps[b].isDone(*std::max_element(nextScore.begin() + b * candidateSize, nextScore.begin() + (b + 1) * candidateSize), curLength);
+        }
+
+        std::vector<std::vector<int64_t>> selected(rows);
+        for (int64_t i=0; i < rows; i++){
+            selected[i] = this->allToken[nextBeamIdx[i]];
+            selected[i].push_back(nextBeamToken[i]);
+        }
+        this->allToken = selected;
+        this->beamScore = nextBeamScore;
+    }
+
+    std::tuple<std::vector<std::vector<int64_t>>, std::vector<float>> finalize(){
+        std::vector<std::vector<int64_t>> bestHyp;
+        std::vector<float> bestScore;
+        for (int64_t b=0; b < this->batchSize; b++){
+            if (!this->done[b]){
+                for (int64_t beam=0; beam < this->beamSize; beam++) this->hyps[b].push(this->allToken[b * this->beamSize + beam], this->beamScore[b * this->beamSize + beam]);
+            }
+            for (int64_t i=0; i < this->returnNum; i++){
+                auto &[score, hyp] = this->hyps[b].beams[i];
+                bestScore.push_back(score);
+                bestHyp.push_back(std::vector<int64_t>(hyp.begin() + 1, hyp.end()));
+            }
+        }
+        return std::make_tuple(bestHyp, bestScore);
+    }
+};
+
+int main(){
+    const int64_t vocabSize = 64;
+    const int64_t beamSize = 10;
+    const int64_t maxLength = 60;
+    const float lengthPenalty = 1.0, T = 1.0;
+    const int64_t bosIds = vocabSize - 4, eosIds = vocabSize - 3, padIds = vocabSize - 2;
+
+    std::mt19937 rng(0);
+    std::normal_distribution<float> logitDist(0.0f, 4.0f);
+
+    int64_t mismatch = 0, compared = 0;
+    std::cout << "batch\tsteps\tfinished early\thypotheses\tmismatch" << std::endl;
+    for (int64_t batchSize : {1, 4, 16}){
+        const int64_t rows = batchSize * beamSize;
+        Inference::SearchMethods mSearch(beamSize, batchSize, bosIds, padIds, eosIds, lengthPenalty, 1, maxLength, 1, T, beamSize, "cpu");
+        legacyBeamSearch ref(batchSize, beamSize, bosIds, eosIds, padIds, lengthPenalty, T, beamSize);
+
+        int64_t steps = 0, finishedEarly = 0;
+        std::vector<float> logits(rows * vocabSize), aliveLogits;
+        while (true){
+            // logits of every row, the search only sees the rows of unfinished elements in batch order
+            for (auto &a : logits) a = logitDist(rng);
+            for (int64_t r=0; r < rows; r++) logits[r * vocabSize + eosIds] += steps * (0.2f + 0.1f * (r / beamSize % 4));
+            aliveLogits.clear();
+            for (int64_t b=0; b < batchSize; b++){
+                if (!mSearch.batchDone(b)) aliveLogits.insert(aliveLogits.end(), logits.begin() + b * beamSize * vocabSize, logits.begin() + (b + 1) * beamSize * vocabSize);
+            }
+            mSearch.generate(aliveLogits.data(), vocabSize, vocabSize);
+            ref.generate(logits, vocabSize);
+            steps++;
+            if (mSearch.isDone() || ref.isDone() || steps + 1 >= maxLength) break;
+            mSearch.unfinishIndex();
+            finishedEarly = 0;
+            for (int64_t b=0; b < batchSize; b++) finishedEarly += mSearch.batchDone(b);
+        }
+
+        auto [hyps, scores] = mSearch.finalize();
+        auto [refHyps, refScores] = ref.finalize();
+        int64_t batchMismatch = hyps.size() != refHyps.size();
+        for (int64_t i=0; !batchMismatch && i < hyps.size(); i++) batchMismatch += hyps[i] != refHyps[i] || scores[i] != refScores[i];
+        mismatch += batchMismatch;
+        compared += refHyps.size();
+        std::cout << batchSize << "\t" << steps << "\t" << finishedEarly << "\t\t" << refHyps.size() << "\t\t" << batchMismatch << std::endl;
+    }
+    std::cout << "hypotheses compared: " << compared << " mismatching batches: " << mismatch << std::endl;
+    return mismatch == 0 ? 0 : 1;
+}
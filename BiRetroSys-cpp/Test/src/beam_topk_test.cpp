@@ -0,0 +1,66 @@
+#include <Test/include_head.h>
+#include <Inference/tensor_utils.h>
+#include <random>
+
+// compare the fused log-softmax + beam score + top-k kernel with the padded
+// lastSoftmax -> add -> lastTopK path used before, on random decoder logits
+int main(){
+    const int64_t vocabSize = 275;
+    const int64_t beamSize = 20;
+    const int64_t topk = beamSize * 2;
+    const float T = 1.0;
+    const int64_t iters = 200;
+
+    std::mt19937 rng(0);
+    std::normal_distribution<float> logitDist(0.0f, 4.0f);
+    std::normal_distribution<float> scoreDist(-5.0f, 2.0f);
+
+    int64_t failed = 0;
+    std::cout << "batch\tlegacy(us)\tfused(us)\tspeedup\tidxMatch\tmaxScoreDiff" << std::endl;
+    for (int64_t batchSize : {1, 4, 16, 64}){
+        const int64_t rows = batchSize * beamSize;
+        std::vector<float> logits(rows * vocabSize);
+        std::vector<float> beamScore(rows);
+        for (auto &a : logits) a = logitDist(rng);
+        for (auto &a : beamScore) a = scoreDist(rng);
+        std::vector<int64_t> alive(batchSize);
+        std::iota(alive.begin(), alive.end(), 0);
+
+        std::vector<float> legacyScore;
+        std::vector<int64_t> legacyIdx;
+        auto legacyBegin = std::chrono::high_resolution_clock::now();
+        for (int64_t it=0; it < iters; it++){
+            float *pad = new float[rows * vocabSize];
+            std::copy(logits.begin(), logits.end(), pad);
+            std::vector<int64_t> shape = {rows, vocabSize};
+            Inference::lastSoftmax(pad, shape, T, true);
+            for (int64_t i=0; i < rows; i++){
+                auto score = beamScore[i];
+                std::for_each(pad + i * vocabSize, pad + (i + 1) * vocabSize, [&score](float &a){a += score;});
+            }
+            shape = {batchSize, 1, beamSize * vocabSize};
+            std::tie(legacyScore, legacyIdx) = Inference::lastTopK(pad, shape, topk, true, true);
+        }
+        auto legacyEnd = std::chrono::high_resolution_clock::now();
+
+        std::vector<float> fusedScore(batchSize * topk);
+        std::vector<int64_t> fusedIdx(batchSize * topk);
+        auto fusedBegin = std::chrono::high_resolution_clock::now();
+        for (int64_t it=0; it < iters; it++){
+            Inference::fusedBeamTopK(logits.data(), vocabSize, vocabSize, beamScore.data(), alive, batchSize, beamSize, topk, T, fusedScore.data(), fusedIdx.data());
+        }
+        auto fusedEnd = std::chrono::high_resolution_clock::now();
+
+        int64_t match = 0;
+        float maxDiff = 0;
+        for (int64_t i=0; i < batchSize * topk; i++){
+            match += legacyIdx[i] == fusedIdx[i];
+            maxDiff = std::max(maxDiff, std::abs(legacyScore[i] - fusedScore[i]));
+        }
+        auto legacyCost = std::chrono::duration_cast<std::chrono::microseconds>(legacyEnd - legacyBegin).count() / double(iters);
+        auto fusedCost = std::chrono::duration_cast<std::chrono::microseconds>(fusedEnd - fusedBegin).count() / double(iters);
+        std::printf("%lld\t%.2f\t\t%.2f\t\t%.2fx\t%lld/%lld\t%.2e\n", (long long)batchSize, legacyCost, fusedCost, legacyCost / fusedCost, (long long)match, (long long)(batchSize * topk), maxDiff);
+        failed += match != batchSize * topk || maxDiff > 3e-6;
+    }
+    return failed == 0 ? 0 : 1;
+}
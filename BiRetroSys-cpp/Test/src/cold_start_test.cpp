@@ -0,0 +1,50 @@
+#include <Test/include_head.h>
+#include <Inference/model_utils.h>
+
+// time to first expansion of the first routes_test.txt target, from acquiring the model to the first
+// retro beam search: without the optimized cache, filling it, loading from it, and loading from it with warm-up.
+// sessions are released between runs, the model files stay in the OS page cache after the first one
+int main(){
+    const int64_t beamSize = 20;
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    str target;
+    std::getline(testData, target);
+
+    const str cacheDir = (std::filesystem::temp_directory_path() / "biretrosys_cold_start_test").string();
+    std::filesystem::remove_all(cacheDir);
+
+    auto &registry = Inference::ModelRegistry::instance();
+    std::cout << "run\tload(ms)\tfirst expansion(ms)\ttime to first expansion(ms)\tsecond expansion(ms)" << std::endl;
+    for (const str run : {"no cache", "cache fill", "cache hit", "cache hit + warm-up"}){
+        auto config = Inference::InferenceConfig::load();
+        config.optimizedCache = run != "no cache";
+        config.cacheDir = cacheDir;
+        config.warmUp = run == "cache hit + warm-up";
+        registry.setConfig(config);
+
+        auto loadBegin = std::chrono::high_resolution_clock::now();
+        auto model = registry.acquireInfer(Inference::usptofull, "cpu");
+        auto loadEnd = std::chrono::high_resolution_clock::now();
+        std::vector<int64_t> lTask = {0};
+        model->plannedInferRun({target}, lTask, beamSize, 0.0, 1, 150, 1, 1.0, beamSize);
+        auto firstEnd = std::chrono::high_resolution_clock::now();
+        model->plannedInferRun({target}, lTask, beamSize, 0.0, 1, 150, 1, 1.0, beamSize);
+        auto secondEnd = std::chrono::high_resolution_clock::now();
+
+        double loadMs = std::chrono::duration_cast<std::chrono::microseconds>(loadEnd - loadBegin).count() * 1e-3;
+        double firstMs = std::chrono::duration_cast<std::chrono::microseconds>(firstEnd - loadEnd).count() * 1e-3;
+        double secondMs = std::chrono::duration_cast<std::chrono::microseconds>(secondEnd - firstEnd).count() * 1e-3;
+        std::cout << run << "\t" << loadMs << "\t" << firstMs << "\t" << loadMs + firstMs << "\t" << secondMs << std::endl;
+
+        model.reset();
+        registry.releaseUnused();
+    }
+
+    int64_t cached = 0;
+    for (auto &entry : std::filesystem::directory_iterator(cacheDir)) cached += entry.path().extension() == ".onnx";
+    std::cout << "optimized models in cache: " << cached << std::endl;
+    std::filesystem::remove_all(cacheDir);
+    return cached == 3 ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+#include <Test/include_head.h>
+#include <Inference/tensor_utils.h>
+#include <random>
+#include <cstring>
+#include <execinfo.h>
+#include <dlfcn.h>
+
+// heap allocations of the decoder step. a synthetic batch with random decoder outputs and logits is driven through
+// the preallocated DecodeState (tokens, kept rows, self-attention cache, context compaction) and the fused beam search,
+// and checked against the indexSelect path used before, allocations are counted on this thread and have to
+// be zero. the full decoderStep on the usptofull model has to be free of project allocations as well, what ORT
+// allocates inside Run is told apart by the library of the first caller frame outside the runtime and reported alone
+
+static thread_local bool counting = false;
+static thread_local bool inHook = false;
+static int64_t projectAllocs = 0;
+static int64_t ortAllocs = 0;
+
+static bool runtimeFrame(const char *name){
+    return std::strstr(name, "libstdc++") || std::strstr(name, "libc.so") || std::strstr(name, "libgcc") || std::strstr(name, "libgomp");
+}
+
+__attribute__((noinline)) static void countAllocation(){
+    inHook = true;
+    void *frames[32];
+    const int depth = backtrace(frames, 32);
+    bool fromOrt = false;
+    // frame 0 is this function and frame 1 operator new
+    for (int i=2; i < depth; i++){
+        Dl_info info;
+        if (!dladdr(frames[i], &info) || !info.dli_fname) break;
+        if (runtimeFrame(info.dli_fname)) continue;
+        fromOrt = std::strstr(info.dli_fname, "onnxruntime") != nullptr;
+        break;
+    }
+    if (fromOrt) ortAllocs++;
+    else projectAllocs++;
+    inHook = false;
+}
+
+void *operator new(size_t size){
+    if (counting && !inHook) countAllocation();
+    void *ptr = std::malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size){return operator new(size);}
+
+void operator delete(void *ptr) noexcept {std::free(ptr);}
+
+void operator delete(void *ptr, size_t) noexcept {std::free(ptr);}
+
+void operator delete[](void *ptr) noexcept {std::free(ptr);}
+
+void operator delete[](void *ptr, size_t) noexcept {std::free(ptr);}
+
+template <typename T>
+T *repeatRows(const std::vector<T> &base, const int64_t batchSize, const int64_t beamSize){
+    const int64_t rowSize = base.size() / batchSize;
+    T *data = new T[base.size() * beamSize];
+    for (int64_t b=0; b < batchSize; b++){
+        for (int64_t beam=0; beam < beamSize; beam++) std::copy(base.begin() + b * rowSize, base.begin() + (b + 1) * rowSize, data + (b * beamSize + beam) * rowSize);
+    }
+    return data;
+}
+
+int main(){
+    const int64_t batchSize = 8;
+    const int64_t beamSize = 10;
+    const int64_t layers = 8;
+    const int64_t dModel = 64;
+    const int64_t contextLength = 24;
+    const int64_t vocabSize = 64;
+    const int64_t maxLength = 60;
+    const int64_t rows = batchSize * beamSize;
+    const int64_t bosIds = vocabSize - 4, eosIds = vocabSize - 3, padIds = vocabSize - 2;
+
+    std::mt19937 rng(0);
+    std::normal_distribution<float> valueDist(0.0f, 1.0f);
+    std::bernoulli_distribution maskDist(0.8);
+
+    Inference::DecodeState state;
+    state.msaShape = {layers, rows, 0, dModel};
+    state.mcaShape = {rows, contextLength, dModel};
+    state.extraEmbShape = {rows, 2, dModel};
+    state.maskShape = {rows, 1, 3, contextLength};
+    state.taskCountShape = {rows};
+    state.numListShape = {2};
+
+    std::vector<float> mcaBase(batchSize * contextLength * dModel);
+    std::vector<char> maskBase(batchSize * 3 * contextLength);
+    std::vector<int64_t> taskBase(batchSize);
+    for (auto &a : mcaBase) a = valueDist(rng);
+    for (auto &a : maskBase) a = maskDist(rng);
+    for (int64_t b=0; b < batchSize; b++) taskBase[b] = b % 2;
+
+    state.extraTokenEmb = new float[rows * 2 * dModel];
+    std::fill(state.extraTokenEmb, state.extraTokenEmb + rows * 2 * dModel, 0.5f);
+    state.mcaCache = repeatRows(mcaBase, batchSize, beamSize);
+    state.taskCount = repeatRows(taskBase, batchSize, beamSize);
+    state.contextMask = new bool[rows * 3 * contextLength];
+    for (int64_t r=0; r < rows; r++){
+        for (int64_t i=0; i < 3 * contextLength; i++) state.contextMask[r * 3 * contextLength + i] = maskBase[(r / beamSize) * 3 * contextLength + i];
+    }
+    state.numList = Inference::constBinCount(state.taskCount, rows, {0, 1});
+    state.reserve(maxLength, vocabSize);
+
+    // legacy reference, every step allocates new buffers
+    std::vector<int64_t> refMcaShape = state.mcaShape, refMaskShape = state.maskShape, refTaskShape = state.taskCountShape, refMsaShape;
+    float *refMca = new float[Inference::numel(refMcaShape)];
+    bool *refMask = new bool[Inference::numel(refMaskShape)];
+    int64_t *refTask = new int64_t[rows];
+    std::copy(state.mcaCache, state.mcaCache + Inference::numel(refMcaShape), refMca);
+    std::copy(state.contextMask, state.contextMask + Inference::numel(refMaskShape), refMask);
+    std::copy(state.taskCount, state.taskCount + rows, refTask);
+    float *refMsa = nullptr;
+
+    // backtrace loads libgcc on its first call, which allocates
+    void *warmFrames[4];
+    backtrace(warmFrames, 4);
+
+    Inference::SearchMethods mSearch(beamSize, batchSize, bosIds, padIds, eosIds, 1.0, 1, maxLength, 1, 1.0, beamSize, "cpu");
+    Inference::SearchMethods mRef(beamSize, batchSize, bosIds, padIds, eosIds, 1.0, 1, maxLength, 1, 1.0, beamSize, "cpu");
+
+    int64_t steps = 0, rowDrops = 0, mismatch = 0;
+    std::vector<float> logits;
+    for (int64_t s=0; s < maxLength; s++){
+        counting = true;
+        const int64_t tokenRows = mSearch.currentToken(state.tokens);
+        counting = false;
+        auto refTokens = mRef.currentToken();
+        mismatch += tokenRows != refTokens.size() || !std::equal(refTokens.begin(), refTokens.end(), state.tokens);
+
+        // what the decoder would write: the grown self-attention cache and the scores of every query position
+        const int64_t curRows = state.rows();
+        const int64_t queryLength = state.extraQ[0] + 1;
+        state.msaOutShape = {layers, curRows, state.msaShape[2] + queryLength, dModel};
+        for (int64_t i=0; i < Inference::numel(state.msaOutShape); i++) state.msaOutput[i] = valueDist(rng);
+        logits.resize(curRows * queryLength * vocabSize);
+        for (auto &a : logits) a = valueDist(rng) * 4;
+        for (int64_t r=0; r < curRows * queryLength; r++) logits[r * vocabSize + eosIds] += s * 0.4f;
+        counting = true;
+        mSearch.generate(logits.data() + (queryLength - 1) * vocabSize, queryLength * vocabSize, vocabSize);
+        counting = false;
+        mRef.generate(logits.data() + (queryLength - 1) * vocabSize, queryLength * vocabSize, vocabSize);
+        steps++;
+        if (mSearch.isDone() || s + 1 >= maxLength) break;
+
+        // keepRows may swap the cache buffers, the reference copies the decoder output first
+        auto refIdx = mRef.unfinishIndex();
+        delete []refMsa;
+        refMsaShape = state.msaOutShape;
+        refMsa = Inference::indexSelect(state.msaOutput, refMsaShape, refIdx, 1, false);
+
+        counting = true;
+        mSearch.unfinishIndex(state.keepIdx);
+        state.keepRows(state.keepIdx);
+        counting = false;
+        rowDrops += state.rows() != curRows;
+
+        if (s == 0) refMask = Inference::indexSelect(refMask, refMaskShape, {0}, 2);
+        refMca = Inference::indexSelect(refMca, refMcaShape, refIdx, 0);
+        refTask = Inference::indexSelect(refTask, refTaskShape, refIdx, 0);
+        refMask = Inference::indexSelect(refMask, refMaskShape, refIdx, 0);
+        auto refNumList = Inference::constBinCount(refTask, refTaskShape[0], {0, 1});
+
+        bool same = refIdx == state.keepIdx && refMsaShape == state.msaShape && refMcaShape == state.mcaShape && refMaskShape == state.maskShape;
+        same = same && std::equal(refMsa, refMsa + Inference::numel(refMsaShape), state.msaInput);
+        same = same && std::equal(refMca, refMca + Inference::numel(refMcaShape), state.mcaCache);
+        same = same && std::equal(refMask, refMask + Inference::numel(refMaskShape), state.contextMask);
+        same = same && std::equal(refTask, refTask + refTaskShape[0], state.taskCount) && refNumList == state.numList;
+        mismatch += !same;
+    }
+    delete []refMsa;
+    delete []refMca;
+    delete []refMask;
+    delete []refTask;
+
+    std::cout << "synthetic batch: steps " << steps << " row drops " << rowDrops << " mismatching steps " << mismatch << std::endl;
+    std::cout << "step allocations: " << projectAllocs << " (" << projectAllocs / double(std::max<int64_t>(1, steps)) << " per step)" << std::endl;
+    const bool syntheticFree = projectAllocs + ortAllocs == 0 && mismatch == 0;
+
+    // the whole step on the model
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> targets;
+    str tgt;
+    while (std::getline(testData, tgt) && targets.size() < 4) targets.push_back(tgt);
+
+    auto model = Inference::ModelRegistry::instance().acquireInfer(Inference::usptofull, "cpu");
+    std::vector<int64_t> lTask(targets.size(), 0);
+    auto batch = model->molHandler.generateBatch(targets, lTask);
+    Inference::SearchMethods modelSearch(beamSize, targets.size(), model->vocab["<BOS>"], model->vocab["<PAD>"], model->vocab["<EOS>"], 1.0, 1, 150, 1, 1.0, beamSize, "cpu");
+    Inference::DecodeState modelState;
+    model->decoderPrepare(model->encoderRun(batch)[0], model->embeddingRun(batch)[0], batch, modelSearch, modelState);
+
+    projectAllocs = 0;
+    ortAllocs = 0;
+    int64_t modelSteps = 0;
+    bool done = false;
+    while (!done){
+        counting = true;
+        done = model->decoderStep(modelSearch, modelState);
+        counting = false;
+        modelSteps++;
+    }
+    std::cout << "model decoderStep over " << modelSteps << " steps, project allocations: " << projectAllocs << std::endl;
+    std::cout << "ORT allocations inside Run: " << ortAllocs / double(modelSteps) << " per step" << std::endl;
+    return syntheticFree && projectAllocs == 0 ? 0 : 1;
+}
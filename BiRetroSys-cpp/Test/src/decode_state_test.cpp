@@ -0,0 +1,69 @@
+#include <Test/include_head.h>
+#include <Inference/tensor_utils.h>
+#include <random>
+
+// self-attention cache carried between decoder steps by DecodeState::keepRows. every step the decoder output grows by
+// one position (three at the first step, the extra tokens), random kept rows are drawn with reorders, repeated parents,
+// dropped rows and plain identity steps, and msaInput has to equal an explicit indexSelect of the output along the rows
+
+int main(){
+    const int64_t layers = 8;
+    const int64_t rows = 40;
+    const int64_t dModel = 32;
+    const int64_t contextLength = 12;
+    const int64_t maxLength = 30;
+
+    std::mt19937 rng(0);
+    std::normal_distribution<float> valueDist(0.0f, 1.0f);
+
+    Inference::DecodeState state;
+    state.msaShape = {layers, rows, 0, dModel};
+    state.mcaShape = {rows, contextLength, dModel};
+    state.extraEmbShape = {rows, 2, dModel};
+    state.maskShape = {rows, 1, 3, contextLength};
+    state.taskCountShape = {rows};
+    state.numListShape = {2};
+    state.extraTokenEmb = new float[rows * 2 * dModel];
+    state.mcaCache = new float[rows * contextLength * dModel];
+    state.contextMask = new bool[rows * 3 * contextLength];
+    state.taskCount = new int64_t[rows];
+    std::fill(state.mcaCache, state.mcaCache + rows * contextLength * dModel, 0.0f);
+    std::fill(state.contextMask, state.contextMask + rows * 3 * contextLength, true);
+    for (int64_t r=0; r < rows; r++) state.taskCount[r] = r % 2;
+    state.numList = Inference::constBinCount(state.taskCount, rows, {0, 1});
+    state.reserve(maxLength, 16);
+
+    int64_t mismatch = 0, reorders = 0, drops = 0, identity = 0;
+    std::cout << "step\trows\tkept\tkind\t\tmismatch" << std::endl;
+    for (int64_t s=0; s + 1 < maxLength && state.rows() > 1; s++){
+        const int64_t curRows = state.rows();
+        state.msaOutShape = {layers, curRows, state.msaShape[2] + state.extraQ[0] + 1, dModel};
+        for (int64_t i=0; i < Inference::numel(state.msaOutShape); i++) state.msaOutput[i] = valueDist(rng);
+
+        // every third step keeps the rows as they are, the others draw parents, sometimes dropping the last rows
+        std::vector<int64_t> index(curRows);
+        std::iota(index.begin(), index.end(), 0);
+        str kind = "identity";
+        if (s % 3 != 2){
+            std::uniform_int_distribution<int64_t> parentDist(0, curRows - 1);
+            const int64_t keepCount = s % 3 == 1 ? std::max<int64_t>(1, curRows - 1 - s % 4) : curRows;
+            index.resize(keepCount);
+            for (auto &a : index) a = parentDist(rng);
+            kind = keepCount == curRows ? "reorder" : "reorder+drop";
+        }
+        reorders += kind != "identity";
+        drops += index.size() != curRows;
+        identity += kind == "identity";
+
+        std::vector<int64_t> refShape = state.msaOutShape;
+        float *ref = Inference::indexSelect(state.msaOutput, refShape, index, 1, false);
+        state.keepRows(index);
+
+        const bool same = refShape == state.msaShape && std::equal(ref, ref + Inference::numel(refShape), state.msaInput);
+        delete []ref;
+        mismatch += !same;
+        std::cout << s << "\t" << curRows << "\t" << index.size() << "\t" << kind << (kind == "reorder+drop" ? "\t" : "\t\t") << !same << std::endl;
+    }
+    std::cout << "reorders " << reorders << " drops " << drops << " identity " << identity << " mismatching steps " << mismatch << std::endl;
+    return mismatch == 0 ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#include <Test/include_head.h>
+
+// generateBatch on 1 to N OpenMP threads over batches of 1 to 512 routes_test.txt targets,
+// every multi-thread batch has to be identical to the single-thread one
+
+bool sameBatch(const MolHandler::inputData &a, const MolHandler::inputData &b){
+    bool same = a.atomFeat == b.atomFeat && a.bondFeat == b.bondFeat && a.deg == b.deg && a.dist == b.dist
+        && a.queryIdx == b.queryIdx && a.keyIdx == b.keyIdx && a.graphLength == b.graphLength
+        && a.bondSplit == b.bondSplit && a.seqFeat == b.seqFeat && a.seqLength == b.seqLength;
+    for (int i=0; i < a.bondIdx.size(); i++){
+        same = same && a.bondIdx[i] == b.bondIdx[i] && a.attnBondIdx[i] == b.attnBondIdx[i];
+    }
+    for (int i=0; i < a.kBondFeat.size(); i++) same = same && a.kBondFeat[i] == b.kBondFeat[i];
+    return same;
+}
+
+int main(){
+    str testDir = std::filesystem::current_path().parent_path();
+    str vocabDir = testDir + "/Models/50k/vocabulary(uspto_50k).txt";
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> targets;
+    str tgt;
+    while (std::getline(testData, tgt)) targets.push_back(tgt);
+
+    MolHandler::molPreprocess molHandler(vocabDir);
+    #ifdef _OPENMP
+    const int maxThreads = omp_get_max_threads();
+    #else
+    const int maxThreads = 1;
+    #endif
+    std::vector<int> threadList;
+    for (int t=1; t < maxThreads; t*=2) threadList.push_back(t);
+    threadList.push_back(maxThreads);
+
+    int failed = 0;
+    std::cout << "batch";
+    for (int t : threadList) std::cout << "\t" << t << "T(ms)";
+    std::cout << "\tidentical" << std::endl;
+    for (int64_t batchSize : {1, 8, 32, 128, 512}){
+        std::vector<str> smis(batchSize);
+        for (int64_t i=0; i < batchSize; i++) smis[i] = targets[i % targets.size()];
+        std::vector<int64_t> lTasks(batchSize, 0);
+        const int iters = batchSize < 128 ? 10 : 2;
+
+        auto serialRes = molHandler.generateBatch(smis, lTasks, true, 1);
+        bool identical = true;
+        std::cout << batchSize;
+        for (int t : threadList){
+            MolHandler::inputData res;
+            auto begin = std::chrono::high_resolution_clock::now();
+            for (int i=0; i < iters; i++) molHandler.generateBatch(smis, lTasks, res, true, t);
+            auto end = std::chrono::high_resolution_clock::now();
+            identical = identical && sameBatch(serialRes, res);
+            std::cout << "\t" << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() * 1e-3 / iters;
+        }
+        std::cout << "\t" << (identical ? "yes" : "NO") << std::endl;
+        failed += !identical;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#include <Test/include_head.h>
+#include <MolHandler/chem_utils.h>
+
+// CSR graph builder (molPreprocess::buildGraph) against the previous label-matrix + bubble-sort builder,
+// on synthetic molecules of 10 to 300 heavy atoms, outputs have to be identical
+
+// previous builder, kept here as the reference
+void legacyBuildGraph(const RDKit::ROMol &mol, MatRX<float> &atomFeatRes, MatRX<float> &bondFeatRes, MatRX<int64_t> &bondIdxRes){
+    using namespace MolHandler;
+    auto ringInfo = *(mol.getRingInfo());
+    int64_t atomNum = mol.getNumAtoms();
+    int64_t bondNum = mol.getNumBonds();
+    MatRX<int> atomLabel = MatRX<int>::Constant(atomNum, ATOMFEATNUM, -1);
+    MatRX<int> bondLabel = MatRX<int>::Constant(bondNum * 2, BONDFEATNUM, -1);
+    MatRX<float> atomFeat = MatRX<float>::Zero(atomNum, std::accumulate(ATOMFEATDIM.begin(), ATOMFEATDIM.end(), 0));
+    MatRX<float> bondFeat = MatRX<float>::Zero(bondNum * 2, std::accumulate(BONDFEATDIM.begin(), BONDFEATDIM.end(), 0));
+    MatRX<int64_t> bondIdx(2, bondNum * 2);
+
+    int64_t start, end;
+    int rbI = 0;
+    for (auto atom : mol.atoms()){
+        getAtomFeat(*atom, atomLabel.row(rbI).data(), 0, 0, 0, 0);
+        onehotConvert(atomLabel.row(rbI).data(), atomFeat.row(rbI).data(), ATOMFEATDIM);
+        rbI++;
+    }
+    rbI = 0;
+    for (auto bond : mol.bonds()){
+        start = bond->getBeginAtomIdx();
+        end = bond->getEndAtomIdx();
+        bondIdx(0, rbI) = start;
+        bondIdx(1, rbI) = end;
+        bondIdx(0, rbI + 1) = end;
+        bondIdx(1, rbI + 1) = start;
+        getBondFeat(*bond, ringInfo, bondLabel.row(rbI).data());
+        onehotConvert(bondLabel.row(rbI).data(), bondFeat.row(rbI).data(), BONDFEATDIM);
+        std::copy(bondFeat.row(rbI).data(), bondFeat.row(rbI).data() + bondFeat.cols(), bondFeat.row(rbI + 1).data());
+        rbI += 2;
+    }
+    std::vector<int64_t> sortScore(bondIdx.cols());
+    for (int i=0; i <sortScore.size(); i++){sortScore[i] = bondIdx(0, i) * atomNum + bondIdx(1, i);}
+    for (int i=0, srcCount=bondIdx.cols() - 1; i < srcCount; i++){
+        for (int j=0; j < srcCount - i; j++){
+            if (sortScore[j] > sortScore[j+1]){
+                bondIdx.col(j).swap(bondIdx.col(j+1));
+                bondFeat.row(j).swap(bondFeat.row(j+1));
+                std::swap(sortScore[j], sortScore[j+1]);
+            }
+        }
+    }
+    atomFeatRes = atomFeat;
+    bondFeatRes = bondFeat;
+    bondIdxRes = bondIdx;
+}
+
+int main(){
+    // 10 heavy atoms per unit: aromatic ring, amide, branch
+    const str unit = "c1ccc(cc1)C(=O)N";
+    const int iters = 20;
+    MolHandler::molPreprocess molHandler;
+
+    int failed = 0;
+    std::cout << "atoms\tlegacy(us)\tcsr(us)\tspeedup\tidentical" << std::endl;
+    for (int units : {1, 2, 5, 10, 20, 30}){
+        str smi = "C";
+        for (int i=0; i < units; i++) smi += unit;
+        std::unique_ptr<RDKit::ROMol> mol(RDKit::SmilesToMol(smi));
+
+        MatRX<float> atomFeat1, bondFeat1, atomFeat2, bondFeat2;
+        MatRX<int64_t> bondIdx1, bondIdx2;
+        auto legacyBegin = std::chrono::high_resolution_clock::now();
+        for (int i=0; i < iters; i++) legacyBuildGraph(*mol, atomFeat1, bondFeat1, bondIdx1);
+        auto legacyEnd = std::chrono::high_resolution_clock::now();
+        for (int i=0; i < iters; i++) molHandler.buildGraph(*mol, atomFeat2, bondFeat2, bondIdx2);
+        auto csrEnd = std::chrono::high_resolution_clock::now();
+
+        double legacyUs = std::chrono::duration_cast<std::chrono::nanoseconds>(legacyEnd - legacyBegin).count() * 1e-3 / iters;
+        double csrUs = std::chrono::duration_cast<std::chrono::nanoseconds>(csrEnd - legacyEnd).count() * 1e-3 / iters;
+        bool identical = atomFeat1 == atomFeat2 && bondFeat1 == bondFeat2 && bondIdx1 == bondIdx2;
+        std::cout << mol->getNumAtoms() << "\t" << legacyUs << "\t" << csrUs << "\t" << legacyUs / csrUs << "\t" << (identical ? "yes" : "NO") << std::endl;
+        failed += !identical;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+#include <Test/include_head.h>
+#include <random>
+
+// generateBatch with the featurization cache against the cache disabled, on a search-like stream of batches
+// that revisit routes_test.txt targets: batches have to be identical, hit rate, evictions and time are reported
+// for the default budget and for a budget that holds about a tenth of the molecules
+
+bool sameBatch(const MolHandler::inputData &a, const MolHandler::inputData &b){
+    bool same = a.atomFeat == b.atomFeat && a.bondFeat == b.bondFeat && a.deg == b.deg && a.dist == b.dist
+        && a.queryIdx == b.queryIdx && a.keyIdx == b.keyIdx && a.graphLength == b.graphLength
+        && a.bondSplit == b.bondSplit && a.lTask == b.lTask;
+    for (int i=0; i < a.bondIdx.size(); i++){
+        same = same && a.bondIdx[i] == b.bondIdx[i] && a.attnBondIdx[i] == b.attnBondIdx[i];
+    }
+    for (int i=0; i < a.kBondFeat.size(); i++) same = same && a.kBondFeat[i] == b.kBondFeat[i];
+    return same;
+}
+
+int main(){
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> targets;
+    str tgt;
+    while (std::getline(testData, tgt)) targets.push_back(tgt);
+
+    // batches of 32 drawn with a skew towards a small working set, both directions of the task label
+    const int batches = 2000;
+    const int batchSize = 32;
+    std::mt19937 rng(0);
+    std::geometric_distribution<int> pick(8.0 / targets.size());
+    std::vector<std::vector<str>> smiBatches(batches, std::vector<str>(batchSize));
+    std::vector<std::vector<int64_t>> taskBatches(batches, std::vector<int64_t>(batchSize));
+    for (int b=0; b < batches; b++){
+        for (int i=0; i < batchSize; i++){
+            smiBatches[b][i] = targets[pick(rng) % targets.size()];
+            taskBatches[b][i] = rng() % 2;
+        }
+    }
+
+    MolHandler::molPreprocess molHandler;
+    int64_t graphBytes = 0;
+    for (auto &smi : targets) graphBytes += MolHandler::graphCache::graphBytes(molHandler.getMolGraph(smi, 0, -1));
+
+    molHandler.cache.setBudget(0);
+    std::vector<MolHandler::inputData> reference;
+    auto uncachedBegin = std::chrono::high_resolution_clock::now();
+    for (int b=0; b < batches; b++) reference.push_back(molHandler.generateBatch(smiBatches[b], taskBatches[b]));
+    auto uncachedEnd = std::chrono::high_resolution_clock::now();
+    double uncachedMs = std::chrono::duration_cast<std::chrono::microseconds>(uncachedEnd - uncachedBegin).count() * 1e-3;
+
+    std::cout << "budget(MB)\ttime(ms)\tspeedup\thit rate\tevictions\tentries\tidentical" << std::endl;
+    std::cout << "0\t" << uncachedMs << "\t1\t0\t0\t0\tyes" << std::endl;
+    int mismatch = 0;
+    for (int64_t budget : {MolHandler::GRAPHCACHEBYTES, graphBytes / 5}){
+        molHandler.cache.clear();
+        molHandler.cache.setBudget(budget);
+        int same = 0;
+        auto cachedBegin = std::chrono::high_resolution_clock::now();
+        for (int b=0; b < batches; b++) same += sameBatch(reference[b], molHandler.generateBatch(smiBatches[b], taskBatches[b]));
+        auto cachedEnd = std::chrono::high_resolution_clock::now();
+        double cachedMs = std::chrono::duration_cast<std::chrono::microseconds>(cachedEnd - cachedBegin).count() * 1e-3;
+        mismatch += batches - same;
+        std::cout << budget / double(1 << 20) << "\t" << cachedMs << "\t" << uncachedMs / cachedMs << "\t" << molHandler.cache.hitRate()
+            << "\t" << molHandler.cache.evictions() << "\t" << molHandler.cache.size() << "\t" << (same == batches ? "yes" : "NO") << std::endl;
+    }
+    return mismatch == 0 ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#include <Test/include_head.h>
+#include <Inference/model_utils.h>
+
+// 1. MPMCQueue under several producers and consumers, every item has to come out exactly once
+// 2. InferService fed by several caller threads, against the same calls made one by one through inferRun
+int main(){
+    {
+        const int64_t producers = 4, consumers = 4, itemNum = 200000;
+        Inference::MPMCQueue<int64_t> queue(256);
+        std::vector<std::atomic<int32_t>> seen(producers * itemNum);
+        std::atomic<int64_t> popped = 0;
+        std::vector<std::thread> workers;
+        for (int64_t p=0; p < producers; p++){
+            workers.emplace_back([&, p](){
+                for (int64_t i=0; i < itemNum; i++){while (!queue.tryPush(p * itemNum + i)) std::this_thread::yield();}
+            });
+        }
+        for (int64_t c=0; c < consumers; c++){
+            workers.emplace_back([&](){
+                int64_t item;
+                while (popped.load() < producers * itemNum){
+                    if (queue.tryPop(item)){seen[item]++; popped++;}
+                    else std::this_thread::yield();
+                }
+            });
+        }
+        for (auto &w : workers) w.join();
+        bool exact = std::all_of(seen.begin(), seen.end(), [](const std::atomic<int32_t> &a){return a.load() == 1;});
+        std::cout << "queue items: " << popped.load() << " exactly once: " << (exact ? "yes" : "no") << std::endl;
+        if (!exact) return 1;
+    }
+
+    const int64_t callers = 8;
+    const int64_t callsPerCaller = 4;
+    const int64_t beamSize = 10;
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> targets;
+    str tgt;
+    while (std::getline(testData, tgt) && targets.size() < callers * callsPerCaller) targets.push_back(tgt);
+
+    auto model = Inference::ModelRegistry::instance().acquireInfer(Inference::usptofull, "cpu");
+
+    auto serialBegin = std::chrono::high_resolution_clock::now();
+    for (auto &smi : targets){
+        std::vector<int64_t> lTask = {0};
+        model->inferRun({smi}, lTask, beamSize, 1, 0.0, 1, 150, 1, 1.0, beamSize);
+    }
+    auto serialEnd = std::chrono::high_resolution_clock::now();
+
+    Inference::InferService service(model, callers, 2000);
+    std::vector<double> queueUs(targets.size()), computeUs(targets.size());
+    std::vector<std::thread> workers;
+    auto serviceBegin = std::chrono::high_resolution_clock::now();
+    for (int64_t c=0; c < callers; c++){
+        workers.emplace_back([&, c](){
+            for (int64_t i=c; i < targets.size(); i+=callers){
+                auto res = service.submit(targets[i], 0, beamSize, 0.0, 150, 1.0, beamSize).get();
+                queueUs[i] = res.queueUs;
+                computeUs[i] = res.computeUs;
+            }
+        });
+    }
+    for (auto &w : workers) w.join();
+    auto serviceEnd = std::chrono::high_resolution_clock::now();
+
+    std::cout << "requests: " << targets.size() << std::endl;
+    std::cout << "serial inferRun(s): " << std::chrono::duration_cast<std::chrono::milliseconds>(serialEnd - serialBegin).count() * 1e-3 << std::endl;
+    std::cout << "service(s): " << std::chrono::duration_cast<std::chrono::milliseconds>(serviceEnd - serviceBegin).count() * 1e-3 << std::endl;
+    std::cout << "mean queue(us): " << std::reduce(queueUs.begin(), queueUs.end()) / queueUs.size() << std::endl;
+    std::cout << "mean compute(us): " << std::reduce(computeUs.begin(), computeUs.end()) / computeUs.size() << std::endl;
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <Test/include_head.h>
+
+// BFS topology features (molPreprocess::getTopoFeat) against the previous adjacency / distance matrix attention bias
+// and dense adjacency-power k-hop generator, on every product and reactant set of the USPTO-50k test split,
+// outputs have to be identical
+
+// previous attention bias, kept here as the reference
+void legacyAttentionBias(const RDKit::ROMol &mol, const int64_t maxDeg, MatRX<int64_t> &degMatrix, MatRX<int64_t> &distMatrix){
+    int atomNum = mol.getNumAtoms();
+    auto adjMatrix = RDKit::MolOps::getAdjacencyMatrix(mol);
+    auto spdMatrix = RDKit::MolOps::getDistanceMat(mol);
+    degMatrix = MatRX<int64_t>::Zero(1, atomNum);
+    distMatrix = MatRX<int64_t>::Constant(1, atomNum * atomNum, -1);
+    for (int i=0; i < atomNum; i++){
+        for (int j=0; j < atomNum; j++){
+            degMatrix(0, i) += *(adjMatrix + i * atomNum + j);
+            distMatrix(0, i * atomNum + j) = MolHandler::getDist(*(spdMatrix + i * atomNum + j));
+        }
+        degMatrix(0, i) = degMatrix(0, i) > maxDeg ? maxDeg : degMatrix(0, i);
+    }
+}
+
+// previous k-hop generator, kept here as the reference
+void legacyKhopFeat(const RDKit::ROMol &mol, const int64_t maxK, const int64_t maxPath, std::vector<MatRX<int64_t>> &kBondIdx, std::vector<MatRX<int64_t>> &kBondFeat){
+    int atomNum = mol.getNumAtoms();
+    std::vector<MatRX<double>> kAdjMatrix;
+    kBondIdx.clear();
+    kBondFeat.clear();
+    Eigen::Map<MatRX<double>> adjMatrix(RDKit::MolOps::getAdjacencyMatrix(mol), atomNum, atomNum);
+    kAdjMatrix.push_back(adjMatrix);
+    for (int i=0; i < maxK - 1; i++){kAdjMatrix.push_back(kAdjMatrix.back() * adjMatrix);}
+    for (auto &matrix : kAdjMatrix){
+        for (int i=0; i < atomNum; i++){matrix(i, i) = 0;}
+    }
+    auto lastPath = kAdjMatrix[0];
+    for (int i=1; i < maxK; i++){
+        MolHandler::matrixFilter(kAdjMatrix[i].data(), lastPath.data(), kAdjMatrix[i].size(), 0, [](const int &val){return val > 0;});
+        lastPath += kAdjMatrix[i];
+    }
+    for (int i=1; i < maxK; i++){
+        auto &iAdj = kAdjMatrix[i];
+        MatRX<int64_t> iBondFeat(atomNum * atomNum, 1);
+        MatRX<int64_t> iBondIdx(2, atomNum * atomNum);
+        int count=0;
+        for (int64_t row=0; row < atomNum; row++){
+            for (int64_t col=0; col < atomNum; col++){
+                if (iAdj(row, col) > 0){
+                    iBondIdx(0, count) = row;
+                    iBondIdx(1, count) = col;
+                    iBondFeat(count, 0) = iAdj(row, col) > maxPath ? maxPath : iAdj(row, col);
+                    count++;
+                }
+            }
+        }
+        kBondIdx.push_back(iBondIdx.leftCols(count));
+        kBondFeat.push_back(iBondFeat.topRows(count));
+    }
+}
+
+int main(){
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/50k/token(test).txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> smis;
+    str line;
+    while (std::getline(testData, line)){
+        auto tab1 = line.find('\t'), tab2 = line.find('\t', tab1 + 1);
+        smis.push_back(line.substr(0, tab1));
+        smis.push_back(line.substr(tab1 + 1, tab2 - tab1 - 1));
+    }
+    // large molecules, where the dense version is cubic in atoms
+    for (int units : {10, 20, 30}){
+        str smi = "C";
+        for (int i=0; i < units; i++) smi += "c1ccc(cc1)C(=O)N";
+        smis.push_back(smi);
+    }
+
+    MolHandler::molPreprocess molHandler;
+    double legacyUs = 0, bfsUs = 0;
+    int64_t molNum = 0, mismatch = 0;
+    for (auto &smi : smis){
+        std::unique_ptr<RDKit::ROMol> mol(RDKit::SmilesToMol(smi));
+        if (!mol) continue;
+        MatRX<int64_t> deg1, dist1, deg2, dist2;
+        std::vector<MatRX<int64_t>> kBondIdx1, kBondFeat1, kBondIdx2, kBondFeat2;
+        auto legacyBegin = std::chrono::high_resolution_clock::now();
+        legacyAttentionBias(*mol, molHandler.maxDeg, deg1, dist1);
+        legacyKhopFeat(*mol, molHandler.maxK, molHandler.maxPath, kBondIdx1, kBondFeat1);
+        auto legacyEnd = std::chrono::high_resolution_clock::now();
+        molHandler.getTopoFeat(*mol, deg2, dist2, kBondIdx2, kBondFeat2);
+        auto bfsEnd = std::chrono::high_resolution_clock::now();
+        legacyUs += std::chrono::duration_cast<std::chrono::nanoseconds>(legacyEnd - legacyBegin).count() * 1e-3;
+        bfsUs += std::chrono::duration_cast<std::chrono::nanoseconds>(bfsEnd - legacyEnd).count() * 1e-3;
+
+        bool same = deg1 == deg2 && dist1 == dist2 && kBondIdx1.size() == kBondIdx2.size();
+        for (int i=0; same && i < kBondIdx1.size(); i++){
+            same = kBondIdx1[i].cols() == kBondIdx2[i].cols() && kBondIdx1[i] == kBondIdx2[i] && kBondFeat1[i] == kBondFeat2[i];
+        }
+        if (!same){
+            mismatch++;
+            std::cout << "mismatch: " << smi << std::endl;
+        }
+        molNum++;
+    }
+    std::cout << "molecules: " << molNum << std::endl;
+    std::cout << "matrix(us/mol): " << legacyUs / molNum << std::endl;
+    std::cout << "bfs(us/mol): " << bfsUs / molNum << std::endl;
+    std::cout << "mismatches: " << mismatch << std::endl;
+    return mismatch > 0 ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+#include <Test/include_head.h>
+#include <Inference/model_utils.h>
+
+// forward consistency check of the retro candidates of routes_test.txt targets, checkWidth beam search through
+// searchTree::inferFun against teacher-forced scoreRun: reports the expansion latency with either check and how
+// often both accept or reject the same candidate at checkLowerBound
+int main(){
+    const int64_t maxTargets = 32;
+    const float lowerBound = 0.1;
+    const float checkLowerBound = 0.01;
+
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> targets;
+    str tgt;
+    // the beam check reports canonical products, so targets are compared in canonical form
+    MolHandler::molPreprocess molHandler;
+    while (std::getline(testData, tgt) && targets.size() < maxTargets) targets.push_back(std::get<0>(molHandler.canonicalizeSmiles(tgt)));
+
+    std::unordered_set<str> terminalMols;
+    Search::searchTree tree(targets[0], "likelihood_check_test", &terminalMols, 20, 20, 150, 1.0);
+    auto model = Inference::ModelRegistry::instance().acquireInfer(Inference::usptofull, "cpu");
+
+    double retroMs = 0, beamMs = 0, scoreMs = 0;
+    int64_t candidates = 0, bothPass = 0, bothFail = 0, beamOnly = 0, scoreOnly = 0;
+    for (auto &target : targets){
+        auto retroBegin = std::chrono::high_resolution_clock::now();
+        auto expandRes = tree.inferFun({target});
+        auto retroEnd = std::chrono::high_resolution_clock::now();
+        retroMs += std::chrono::duration_cast<std::chrono::microseconds>(retroEnd - retroBegin).count() * 1e-3;
+
+        std::vector<str> checkInput;
+        for (auto &[r, s] : expandRes[0]){
+            if (s >= lowerBound) checkInput.push_back(r);
+        }
+        if (checkInput.empty()) continue;
+
+        auto beamBegin = std::chrono::high_resolution_clock::now();
+        auto checkRes = tree.inferFun(checkInput, false);
+        auto beamEnd = std::chrono::high_resolution_clock::now();
+        std::vector<int64_t> lTask(checkInput.size(), 1);
+        auto checkScore = model->scoreRun(checkInput, std::vector<str>(checkInput.size(), target), lTask, 1.0, 150);
+        auto scoreEnd = std::chrono::high_resolution_clock::now();
+        beamMs += std::chrono::duration_cast<std::chrono::microseconds>(beamEnd - beamBegin).count() * 1e-3;
+        scoreMs += std::chrono::duration_cast<std::chrono::microseconds>(scoreEnd - beamEnd).count() * 1e-3;
+
+        for (int i=0; i < checkInput.size(); i++){
+            auto findRes = checkRes[i].find(target);
+            bool beamPass = findRes != checkRes[i].end() && findRes->second >= checkLowerBound;
+            bool scorePass = exp(checkScore[i]) >= checkLowerBound;
+            bothPass += beamPass && scorePass;
+            bothFail += !beamPass && !scorePass;
+            beamOnly += beamPass && !scorePass;
+            scoreOnly += !beamPass && scorePass;
+        }
+        candidates += checkInput.size();
+    }
+
+    std::cout << "targets: " << targets.size() << " candidates: " << candidates << std::endl;
+    std::cout << "retro expansion(ms/target): " << retroMs / targets.size() << std::endl;
+    std::cout << "beam check(ms/target): " << beamMs / targets.size() << " expansion total: " << (retroMs + beamMs) / targets.size() << std::endl;
+    std::cout << "likelihood check(ms/target): " << scoreMs / targets.size() << " expansion total: " << (retroMs + scoreMs) / targets.size() << std::endl;
+    std::cout << "check speedup: " << beamMs / scoreMs << std::endl;
+    std::cout << "agreement: " << bothPass + bothFail << " / " << candidates << " (both pass " << bothPass << ", both reject " << bothFail
+        << ", beam only " << beamOnly << ", likelihood only " << scoreOnly << ")" << std::endl;
+    return 0;
+}
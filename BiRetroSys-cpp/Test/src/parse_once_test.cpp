@@ -0,0 +1,107 @@
+#include <Test/include_head.h>
+
+// featurization of routes_test.txt targets through the owned single-sanitize path against the previous
+// leaking canonicalize + copy-parse path: graphs have to be identical, time per molecule and resident memory
+// are reported, the new path is run over a million molecules and its RSS has to stay flat. molecules parsed in their
+// input atom order have to give the same batch as their SMILES
+
+// previous canonicalizeSmiles + getMolGraph, kept here as the reference (both parses leak, the second one is copied)
+MolHandler::molGraph legacyMolGraph(MolHandler::molPreprocess &molHandler, const str &smi){
+    RDKit::RWMol *mol1 = RDKit::SmilesToMol(smi, 0, false);
+    str canoSmi = "CC";
+    if (mol1 != nullptr){
+        for (auto atom : mol1->atoms()){atom->clearProp("molAtomMapNumber");}
+        canoSmi = RDKit::MolToSmiles(*mol1);
+    }
+    auto mol = *(RDKit::SmilesToMol(canoSmi));
+    MolHandler::molGraph graph;
+    graph.atomNum = mol.getNumAtoms();
+    MatRX<int64_t> bondIdx;
+    molHandler.buildGraph(mol, graph.atomFeat, graph.bondFeat, bondIdx, 0, -1);
+    molHandler.getTopoFeat(mol, graph.deg, graph.dist, graph.bondIdx, graph.kBondFeat);
+    graph.bondIdx.insert(graph.bondIdx.begin(), bondIdx);
+    return graph;
+}
+
+MolHandler::molGraph ownedMolGraph(MolHandler::molPreprocess &molHandler, const str &smi){
+    auto [canoSmi, isValid] = molHandler.canonicalizeSmiles(smi);
+    auto mol = molHandler.parseMol(isValid ? canoSmi : "CC");
+    return molHandler.getMolGraph(*mol, 0, -1);
+}
+
+bool sameGraph(const MolHandler::molGraph &a, const MolHandler::molGraph &b){
+    bool same = a.atomNum == b.atomNum && a.atomFeat == b.atomFeat && a.bondFeat == b.bondFeat
+        && a.deg == b.deg && a.dist == b.dist && a.bondIdx.size() == b.bondIdx.size() && a.kBondFeat.size() == b.kBondFeat.size();
+    for (int i=0; same && i < a.bondIdx.size(); i++) same = a.bondIdx[i] == b.bondIdx[i];
+    for (int i=0; same && i < a.kBondFeat.size(); i++) same = a.kBondFeat[i] == b.kBondFeat[i];
+    return same;
+}
+
+// resident set size in MB from /proc/self/status
+double rssMB(){
+    std::ifstream status("/proc/self/status");
+    str line;
+    while (std::getline(status, line)){
+        if (line.rfind("VmRSS:", 0) == 0) return std::stod(line.substr(6)) / 1024;
+    }
+    return 0;
+}
+
+int main(){
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> targets;
+    str tgt;
+    while (std::getline(testData, tgt)) targets.push_back(tgt);
+
+    MolHandler::molPreprocess molHandler;
+    const int64_t legacyMols = 20000;
+    const int64_t ownedMols = 1000000;
+
+    int mismatch = 0;
+    for (auto &smi : targets) mismatch += !sameGraph(legacyMolGraph(molHandler, smi), ownedMolGraph(molHandler, smi));
+
+    // pre-parsed molecules in their input atom order are renumbered canonically, chiral ones included
+    std::vector<std::unique_ptr<RDKit::ROMol>> owned;
+    std::vector<const RDKit::ROMol*> mols;
+    for (auto &smi : targets){
+        owned.push_back(molHandler.parseMol(smi));
+        mols.push_back(owned.back().get());
+    }
+    std::vector<int64_t> lTasks(targets.size(), 0);
+    MolHandler::inputData fromMols(targets.size(), molHandler.maxK);
+    molHandler.generateBatch(mols, lTasks, fromMols);
+    auto fromSmis = molHandler.generateBatch(targets, lTasks);
+    bool sameBatch = fromMols.atomFeat == fromSmis.atomFeat && fromMols.bondFeat == fromSmis.bondFeat
+        && fromMols.dist == fromSmis.dist && fromMols.graphLength == fromSmis.graphLength;
+    for (int i=0; i < fromMols.bondIdx.size(); i++) sameBatch = sameBatch && fromMols.bondIdx[i] == fromSmis.bondIdx[i];
+
+    double rssStart = rssMB();
+    auto legacyBegin = std::chrono::high_resolution_clock::now();
+    for (int64_t i=0; i < legacyMols; i++) legacyMolGraph(molHandler, targets[i % targets.size()]);
+    auto legacyEnd = std::chrono::high_resolution_clock::now();
+    double rssLegacy = rssMB();
+
+    std::cout << "molecules\towned(us/mol)\tRSS(MB)" << std::endl;
+    double rssFirst = 0, rssLast = 0, ownedUs = 0;
+    auto ownedBegin = std::chrono::high_resolution_clock::now();
+    for (int64_t i=0; i < ownedMols; i++){
+        ownedMolGraph(molHandler, targets[i % targets.size()]);
+        if ((i + 1) % (ownedMols / 10) == 0){
+            auto now = std::chrono::high_resolution_clock::now();
+            ownedUs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - ownedBegin).count() * 1e-3 / (i + 1);
+            rssLast = rssMB();
+            rssFirst = rssFirst > 0 ? rssFirst : rssLast;
+            std::cout << i + 1 << "\t" << ownedUs << "\t" << rssLast << std::endl;
+        }
+    }
+
+    double legacyUs = std::chrono::duration_cast<std::chrono::nanoseconds>(legacyEnd - legacyBegin).count() * 1e-3 / legacyMols;
+    std::cout << "legacy(us/mol): " << legacyUs << " RSS growth over " << legacyMols << " molecules(MB): " << rssLegacy - rssStart << std::endl;
+    std::cout << "owned(us/mol): " << ownedUs << " RSS growth after the first tenth(MB): " << rssLast - rssFirst << std::endl;
+    std::cout << "speedup: " << legacyUs / ownedUs << std::endl;
+    std::cout << "graph mismatches: " << mismatch << " / " << targets.size() << std::endl;
+    std::cout << "pre-parsed batch identical: " << (sameBatch ? "yes" : "NO") << std::endl;
+    return mismatch == 0 && sameBatch ? 0 : 1;
+}
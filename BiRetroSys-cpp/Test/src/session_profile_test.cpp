@@ -0,0 +1,62 @@
+#include <Test/include_head.h>
+#include <Inference/model_utils.h>
+
+// the default, latency and throughput InferenceConfig profiles on routes_test.txt targets:
+// single-request latency (one inferRun per molecule, the interface case) and throughput of several caller
+// threads running their own batches at once (the batch search case). sessions are rebuilt for every profile, on the
+// global pools of the default configuration and on per-session pools
+int main(){
+    const int64_t beamSize = 10;
+    const int64_t latencyRuns = 16;
+    const int64_t callers = 4;
+    const int64_t batchSize = 8;
+
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> targets;
+    str tgt;
+    while (std::getline(testData, tgt) && targets.size() < callers * batchSize) targets.push_back(tgt);
+
+    auto &registry = Inference::ModelRegistry::instance();
+    const bool defaultPool = registry.config().globalThreadPool;
+    std::cout << "profile\tlatency(ms/mol)\tthroughput(mol/s)\tsettings" << std::endl;
+    for (const bool globalPool : {defaultPool, !defaultPool}){
+        for (const str profile : {"default", "latency", "throughput"}){
+            // global pools only exist when the process started with them, sessions then fall back to their own pools
+            auto config = Inference::InferenceConfig::fromProfile(profile);
+            config.globalThreadPool = globalPool;
+            registry.setConfig(config);
+            auto model = registry.acquireInfer(Inference::usptofull, "cpu");
+            std::vector<int64_t> warmTask = {0};
+            model->inferRun({targets[0]}, warmTask, beamSize, 1, 0.0, 1, 150, 1, 1.0, beamSize);
+
+            auto latencyBegin = std::chrono::high_resolution_clock::now();
+            for (int64_t i=0; i < latencyRuns; i++){
+                std::vector<int64_t> lTask = {0};
+                model->inferRun({targets[i % targets.size()]}, lTask, beamSize, 1, 0.0, 1, 150, 1, 1.0, beamSize);
+            }
+            auto latencyEnd = std::chrono::high_resolution_clock::now();
+
+            std::vector<std::thread> workers;
+            auto throughputBegin = std::chrono::high_resolution_clock::now();
+            for (int64_t c=0; c < callers; c++){
+                workers.emplace_back([&, c](){
+                    std::vector<str> smis(targets.begin() + c * batchSize, targets.begin() + std::min<int64_t>((c + 1) * batchSize, targets.size()));
+                    std::vector<int64_t> lTask(smis.size(), 0);
+                    model->inferRun(smis, lTask, beamSize, smis.size(), 0.0, 1, 150, 1, 1.0, beamSize);
+                });
+            }
+            for (auto &w : workers) w.join();
+            auto throughputEnd = std::chrono::high_resolution_clock::now();
+
+            double latencyMs = std::chrono::duration_cast<std::chrono::microseconds>(latencyEnd - latencyBegin).count() * 1e-3 / latencyRuns;
+            double throughput = targets.size() / (std::chrono::duration_cast<std::chrono::microseconds>(throughputEnd - throughputBegin).count() * 1e-6);
+            std::cout << profile << "\t" << latencyMs << "\t" << throughput << "\t" << registry.config().describe() << std::endl;
+
+            model.reset();
+            registry.releaseUnused();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include <Test/include_head.h>
+#include <Inference/model_utils.h>
+
+// several caller threads each running their own retro batches of routes_test.txt targets at once, as batch search
+// does: the process-wide thread budget (one team of every core shared by the OpenMP loops, the global ORT intra-op pool
+// is sized from it) against a budget of one full team per caller, which is what every loop took before
+int main(){
+    const int64_t beamSize = 10;
+    const int64_t callers = 4;
+    const int64_t batchSize = 8;
+    const int64_t rounds = 3;
+    const int cores = std::max(1u, std::thread::hardware_concurrency());
+
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> targets;
+    str tgt;
+    while (std::getline(testData, tgt) && targets.size() < callers * batchSize) targets.push_back(tgt);
+
+    auto &registry = Inference::ModelRegistry::instance();
+    auto &budget = MolHandler::threadBudget::instance();
+    auto model = registry.acquireInfer(Inference::usptofull, "cpu");
+    std::vector<int64_t> warmTask = {0};
+    model->inferRun({targets[0]}, warmTask, beamSize, 1, 0.0, 1, 150, 1, 1.0, beamSize);
+
+    std::cout << "budget\tthroughput(mol/s)\tpeak leased threads\tsettings" << std::endl;
+    for (const int threads : {cores, int(callers) * cores}){
+        budget.setBudget(threads);
+        std::atomic<bool> running{true};
+        int peak = 0;
+        std::thread monitor([&](){
+            while (running){
+                peak = std::max(peak, budget.inUse());
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        });
+
+        auto begin = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> workers;
+        for (int64_t c=0; c < callers; c++){
+            workers.emplace_back([&, c](){
+                std::vector<str> smis(targets.begin() + c * batchSize, targets.begin() + std::min<int64_t>((c + 1) * batchSize, targets.size()));
+                std::vector<int64_t> lTask(smis.size(), 0);
+                for (int64_t r=0; r < rounds; r++) model->inferRun(smis, lTask, beamSize, smis.size(), 0.0, 1, 150, 1, 1.0, beamSize);
+            });
+        }
+        for (auto &w : workers) w.join();
+        auto end = std::chrono::high_resolution_clock::now();
+        running = false;
+        monitor.join();
+
+        double throughput = targets.size() * rounds / (std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() * 1e-6);
+        std::cout << threads << "\t" << throughput << "\t" << peak << "\t" << registry.config().describe() << std::endl;
+    }
+    budget.setBudget(registry.config().threadBudget);
+    return budget.inUse() == 0 ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+#include <Test/include_head.h>
+#include <MolHandler/chem_utils.h>
+#include <regex>
+
+// hand-written tokenizer and tokenTable against the previous std::regex tokenizer and std::map vocabularies,
+// on every product and reactant set of the USPTO-50k test split: tokens have to be identical,
+// throughput is reported for SMILES -> ids and ids -> SMILES
+
+// previous tokenizer, kept here as the reference
+const std::regex SMIREGEX(R"(\[[^\]]+\]|Br?|Cl?|N|O|S|P|F|I|b|c|n|o|s|p|\(|\)|\.|=|#|-|\+|\\|\/|:|~|@|\?|>|\*|\$|\%[0-9]{2}|[0-9])");
+
+int main(){
+    str modelDir = std::filesystem::current_path().parent_path();
+    modelDir += "/Models/50k/";
+    std::ifstream testData(modelDir + "token(test).txt", std::ios::in);
+    std::vector<str> smis;
+    str line;
+    while (std::getline(testData, line)){
+        auto tab1 = line.find('\t'), tab2 = line.find('\t', tab1 + 1);
+        smis.push_back(line.substr(0, tab1));
+        smis.push_back(line.substr(tab1 + 1, tab2 - tab1 - 1));
+    }
+    // unterminated and empty brackets, lone ring-bond '%', characters outside every token
+    for (str smi : {"[CH3", "C[]C", "[]C]", "C%1C%12", "c1ccccc1%", "CClBrBr[Na+].[Cl-]", "Hx?>$~@@"}) smis.push_back(smi);
+
+    MolHandler::molPreprocess molHandler;
+    auto vocab = molHandler.readVocabulary(modelDir + "vocabulary(uspto_50k).txt");
+    molHandler.setVocabulary(vocab);
+    std::map<int64_t, str> rvocab;
+    for (auto &[token, id] : vocab) rvocab[id] = token;
+    const int64_t unkId = vocab["<UNK>"];
+    const auto &table = molHandler.vocabTable;
+
+    // SMILES -> ids
+    int64_t tokenNum = 0, mismatch = 0;
+    std::vector<std::vector<int64_t>> regexIds(smis.size()), tableIds(smis.size());
+    auto regexBegin = std::chrono::high_resolution_clock::now();
+    for (int64_t i=0; i < smis.size(); i++){
+        for (std::sregex_iterator it(smis[i].begin(), smis[i].end(), SMIREGEX), end; it != end; it++){
+            regexIds[i].push_back(MolHandler::mapGet(vocab, it->str(), unkId));
+        }
+    }
+    auto regexEnd = std::chrono::high_resolution_clock::now();
+    std::vector<std::string_view> tokens;
+    for (int64_t i=0; i < smis.size(); i++){
+        MolHandler::tokenizeSmiles(smis[i], tokens);
+        for (auto token : tokens) tableIds[i].push_back(table.find(token, unkId));
+    }
+    auto tableEnd = std::chrono::high_resolution_clock::now();
+
+    for (int64_t i=0; i < smis.size(); i++){
+        tokenNum += regexIds[i].size();
+        std::vector<str> regexTokens, handTokens;
+        for (std::sregex_iterator it(smis[i].begin(), smis[i].end(), SMIREGEX), end; it != end; it++) regexTokens.push_back(it->str());
+        MolHandler::tokenizeSmiles(smis[i], tokens);
+        for (auto token : tokens) handTokens.emplace_back(token);
+        if (regexTokens != handTokens || regexIds[i] != tableIds[i]){
+            mismatch++;
+            std::cout << "mismatch: " << smis[i] << std::endl;
+        }
+    }
+
+    // ids -> SMILES
+    int64_t detokMismatch = 0;
+    std::vector<str> mapStrs(smis.size()), tableStrs(smis.size());
+    auto mapBegin = std::chrono::high_resolution_clock::now();
+    for (int64_t i=0; i < smis.size(); i++){
+        for (auto idx : regexIds[i]){
+            auto findRes = rvocab.find(idx);
+            if (findRes != rvocab.end()) mapStrs[i] += findRes->second;
+        }
+    }
+    auto mapEnd = std::chrono::high_resolution_clock::now();
+    for (int64_t i=0; i < smis.size(); i++){
+        for (auto idx : tableIds[i]) tableStrs[i] += table.token(idx);
+    }
+    auto detokEnd = std::chrono::high_resolution_clock::now();
+    for (int64_t i=0; i < smis.size(); i++) detokMismatch += (mapStrs[i] != tableStrs[i]);
+
+    auto perSecond = [&](auto begin, auto end){return tokenNum / (std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() * 1e-9);};
+    std::cout << "strings: " << smis.size() << " tokens: " << tokenNum << std::endl;
+    std::cout << "regex + map tokenize(tokens/s): " << perSecond(regexBegin, regexEnd) << std::endl;
+    std::cout << "hand + table tokenize(tokens/s): " << perSecond(regexEnd, tableEnd) << std::endl;
+    std::cout << "map detokenize(tokens/s): " << perSecond(mapBegin, mapEnd) << std::endl;
+    std::cout << "table detokenize(tokens/s): " << perSecond(mapEnd, detokEnd) << std::endl;
+    std::cout << "tokenize mismatches: " << mismatch << " detokenize mismatches: " << detokMismatch << std::endl;
+    return mismatch + detokMismatch > 0 ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+#include <Test/include_head.h>
+#include <Search/value_fun.h>
+
+// parity and latency of the native sparse value MLP against valueMLP.onnx through ORT,
+// on every molecule of routes_test.txt
+int main(){
+    str testDir = std::filesystem::current_path().parent_path();
+    testDir += "/Models/routes_test.txt";
+    std::ifstream testData(testDir, std::ios::in);
+    std::vector<str> smis;
+    str tgt;
+    while (std::getline(testData, tgt)) smis.push_back(tgt);
+
+    Search::valueModel ortModel("cpu", false);
+    Search::valueModel nativeModel("cpu", true);
+    // a silent fallback to ORT would compare ORT with itself
+    if (!nativeModel.isNative()){
+        std::cout << "valueMLP.onnx is not supported by the native MLP (FAIL)" << std::endl;
+        return 1;
+    }
+
+    auto ortBegin = std::chrono::high_resolution_clock::now();
+    std::vector<float> ortRes;
+    for (auto &smi : smis){
+        auto res = ortModel.valueRun({smi});
+        ortRes.push_back(res[0]);
+    }
+    auto ortEnd = std::chrono::high_resolution_clock::now();
+
+    std::vector<float> nativeRes;
+    for (auto &smi : smis){
+        auto res = nativeModel.valueRun({smi});
+        nativeRes.push_back(res[0]);
+    }
+    auto nativeEnd = std::chrono::high_resolution_clock::now();
+
+    auto batchRes = nativeModel.valueRun(smis);
+
+    float maxDiff = 0;
+    for (int i=0; i < smis.size(); i++){
+        maxDiff = std::max(maxDiff, std::abs(ortRes[i] - nativeRes[i]));
+        maxDiff = std::max(maxDiff, std::abs(ortRes[i] - batchRes[i]));
+    }
+    std::cout << "molecules: " << smis.size() << std::endl;
+    std::cout << "ORT(us/mol): " << std::chrono::duration_cast<std::chrono::nanoseconds>(ortEnd - ortBegin).count() * 1e-3 / smis.size() << std::endl;
+    std::cout << "native(us/mol): " << std::chrono::duration_cast<std::chrono::nanoseconds>(nativeEnd - ortEnd).count() * 1e-3 / smis.size() << std::endl;
+    std::cout << "max abs diff: " << maxDiff << (maxDiff < 1e-4 ? " (pass)" : " (FAIL)") << std::endl;
+    return maxDiff < 1e-4 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#include <Test/include_head.h>
+#include <Search/tree_utils.h>
+#include <random>
+
+// grow a synthetic Retro* tree to ~1e5 molecule nodes by expanding the open node with the lowest vmt,
+// then time the incremental upToDownUpdate against the previous full re-walk and compare the vmt values
+
+// previous moleculeNode::updateVmt / upToDownUpdate, kept here as the reference
+void legacyUpdateVmt(Search::moleculeNode *mol);
+
+void legacyReactionVmt(Search::reactionNode *reaction){
+    for (const auto mol : reaction->children) legacyUpdateVmt(mol);
+}
+
+void legacyUpdateVmt(Search::moleculeNode *mol){
+    mol->vmt = 0;
+    if (!mol->parent) mol->vmt = mol->rn;
+    else{
+        mol->vmt += mol->parent->costs;
+        Search::reactionNode *temp = mol->parent;
+        while (temp){
+            for (const auto m : temp->children) mol->vmt += m->rn;
+            temp = temp->parent->parent;
+        }
+        for (const auto &reaction : mol->children) legacyReactionVmt(reaction);
+    }
+}
+
+void legacyUpToDownUpdate(Search::moleculeNode *mol){
+    if (!mol->parent){
+        for (const auto &child : mol->children) legacyReactionVmt(child);
+    }
+    else if (!mol->parent->parent->parent) legacyReactionVmt(mol->parent);
+    else legacyUpToDownUpdate(mol->parent->parent);
+}
+
+int main(){
+    const int targetNodes = 100000;
+    const int measureSteps = 200;
+    const int reactionsPerStep = 5;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> valueDist(0.5f, 5.0f);
+    std::uniform_real_distribution<float> costDist(0.1f, 3.0f);
+    std::uniform_int_distribution<int> reactantDist(1, 3);
+
+    Search::openList openNodes;
+    std::vector<Search::moleculeNode*> molNodes;
+    std::vector<Search::reactionNode*> reacNodes;
+    auto addMol = [&](Search::reactionNode *parent, float value){
+        auto mol = new Search::moleculeNode(molNodes.size(), "", value, parent, false);
+        mol->openNodes = &openNodes;
+        openNodes.push(mol);
+        molNodes.push_back(mol);
+    };
+    auto expand = [&](Search::moleculeNode *startMol){
+        for (int i=0; i < reactionsPerStep; i++){
+            auto reaction = new Search::reactionNode(reacNodes.size(), costDist(rng), startMol);
+            for (int j=reactantDist(rng); j > 0; j--) addMol(reaction, valueDist(rng));
+            reaction->init();
+            reacNodes.push_back(reaction);
+        }
+        startMol->init();
+    };
+
+    addMol(nullptr, valueDist(rng));
+    while (molNodes.size() < targetNodes){
+        auto startMol = openNodes.top();
+        expand(startMol);
+        startMol->upToDownUpdate();
+    }
+
+    double incrementalUs = 0, legacyUs = 0, maxDiff = 0;
+    int sameSelect = 0;
+    for (int step=0; step < measureSteps; step++){
+        auto startMol = openNodes.top();
+        expand(startMol);
+
+        auto incBegin = std::chrono::high_resolution_clock::now();
+        startMol->upToDownUpdate();
+        auto incEnd = std::chrono::high_resolution_clock::now();
+        incrementalUs += std::chrono::duration_cast<std::chrono::nanoseconds>(incEnd - incBegin).count() * 1e-3;
+
+        std::vector<float> incVmt(molNodes.size());
+        for (int i=0; i < molNodes.size(); i++) incVmt[i] = molNodes[i]->vmt;
+        auto nextInc = openNodes.top();
+
+        auto legacyBegin = std::chrono::high_resolution_clock::now();
+        legacyUpToDownUpdate(startMol);
+        auto legacyEnd = std::chrono::high_resolution_clock::now();
+        legacyUs += std::chrono::duration_cast<std::chrono::nanoseconds>(legacyEnd - legacyBegin).count() * 1e-3;
+
+        Search::moleculeNode *nextLegacy = nullptr;
+        float minCost = MAXFLOAT;
+        for (int i=0; i < molNodes.size(); i++){
+            if (molNodes[i]->parent) maxDiff = std::max(maxDiff, (double)std::abs(incVmt[i] - molNodes[i]->vmt) / std::max(1.0f, std::abs(molNodes[i]->vmt)));
+            if (molNodes[i]->isOpen && molNodes[i]->vmt < minCost){
+                minCost = molNodes[i]->vmt;
+                nextLegacy = molNodes[i];
+            }
+            molNodes[i]->vmt = incVmt[i];
+        }
+        sameSelect += (nextInc == nextLegacy);
+    }
+
+    std::cout << "molecule nodes: " << molNodes.size() << " reaction nodes: " << reacNodes.size() << std::endl;
+    std::cout << "legacy update(us/step): " << legacyUs / measureSteps << std::endl;
+    std::cout << "incremental update(us/step): " << incrementalUs / measureSteps << std::endl;
+    std::cout << "speedup: " << legacyUs / incrementalUs << std::endl;
+    std::cout << "max relative vmt diff: " << maxDiff << std::endl;
+    std::cout << "same selection: " << sameSelect << " / " << measureSteps << std::endl;
+
+    for (auto p : molNodes) delete p;
+    for (auto p : reacNodes) delete p;
+    return maxDiff <= 1e-6 && sameSelect == measureSteps ? 0 : 1;
+}
@@ -1,6 +1,8 @@
 #include "main_window.h"
 
 int main(int argc, char *argv[]){
+    // one interactive search at a time, sessions take the latency profile unless BIRETRO_PROFILE is set
+    setenv("BIRETRO_PROFILE", "latency", 0);
     QApplication app(argc, argv);
     mainWindow w;
     w.loadTerminalMols();